@@ -0,0 +1,446 @@
+// Benchmarks for the scan processing and correlation hot path in lidar_core.h.
+//
+// Build from the repo root with `make bench` (Google Benchmark, jsoncpp and
+// the RPLIDAR SDK headers are the only dependencies; no ZMQ or LiDAR needed).
+//
+// Run with synthetic data only, or add a --capture log to also time the
+// recorded revolutions in it:
+//   bench/lidar_core_bench [capture.scap] [--benchmark_filter=...]
+//
+// Every benchmark reports allocs_per_iter next to the time per iteration;
+// the steady-state hot path is expected to stay at 0.
+
+#include "lidar_core.h"
+
+#include <benchmark/benchmark.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#define BENCH_SCAN_NODES MAX_SCAN_NODES  // Nodes per synthetic revolution, the SDK buffer size
+#define BENCH_FRAME_MS 33         // Camera frame spacing for the correlation benchmarks
+#define BENCH_OBJECT_HALF_DEG 1.0  // Half-width of a synthetic object, narrow enough for the wall to show between them
+
+// Revolutions are timed as if captured back to back at the nominal rate
+static const ScanTiming BENCH_TIMING = { 1000000000ULL, SCAN_PERIOD_MS * 1000000ULL, 0 };
+
+// Binning state of the one benchmarked sensor, default geometry
+static ScanContext g_context;
+
+// Count heap allocations so each benchmark can report allocations per iteration
+static std::atomic<uint64_t> g_allocations{0};
+
+// Every replaced form goes through these two. Kept out of line so the
+// compiler never sees a new-expression paired with free() and warns
+// (-Wmismatched-new-delete).
+__attribute__((noinline)) static void* countedAlloc(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) static void countedFree(void* p) noexcept { free(p); }
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+
+// Report allocations made since start, averaged over the benchmark's iterations
+static void reportAllocations(benchmark::State& state, uint64_t start) {
+    state.counters["allocs_per_iter"] = benchmark::Counter(
+        static_cast<double>(g_allocations.load(std::memory_order_relaxed) - start),
+        benchmark::Counter::kAvgIterations);
+}
+
+// The tracking benchmarks are labelled with the number of objects they
+// track; fail the run instead of timing fewer because synthetic blobs
+// merged or were dropped. Args stop at MAX_TRACKED_OBJECTS for that reason.
+static void checkObjectCount(benchmark::State& state, int objects) {
+    state.counters["objects"] = g_object_count;
+    if (g_object_count != objects) state.SkipWithError("synthetic objects were merged or dropped");
+}
+
+typedef std::vector<sl_lidar_response_measurement_node_hq_t> NodeScan;
+
+// A revolution in ascending angle order: a wall at 2.8m with `objects`
+// closer blobs spread over the front arc, plus range noise and dropouts.
+// Each blob is its own cluster, inside the default MAX_DISTANCE_MM.
+static NodeScan makeSyntheticScan(int objects, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 15.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    NodeScan scan(BENCH_SCAN_NODES);
+    for (int i = 0; i < BENCH_SCAN_NODES; i++) {
+        float raw = i * 360.0f / BENCH_SCAN_NODES;
+        float angle = convertRawAngleToDegrees(raw);
+
+        float distance = 2800.0f;
+        for (int k = 0; k < objects; k++) {
+            float center = -80.0f + 160.0f * (k + 0.5f) / objects;
+            if (fabsf(angle - center) < BENCH_OBJECT_HALF_DEG) distance = 800.0f + 1400.0f * k / objects;
+        }
+        distance += noise(rng);
+        if (unit(rng) < 0.02f) distance = 0.0f;  // No return
+
+        sl_lidar_response_measurement_node_hq_t& node = scan[i];
+        node.angle_z_q14 = static_cast<uint16_t>(raw / 90.0f * (1 << 14));
+        node.dist_mm_q2 = static_cast<uint32_t>(std::max(distance, 0.0f) * 4.0f);
+        node.quality = distance > 0.0f ? 188 : 0;
+        node.flag = i == 0 ? 1 : 0;
+    }
+    return scan;
+}
+
+// A detection message in the JSON layout docker_detection_refined.py sends,
+// with `count` detections spread across the camera's field of view
+static std::string makeDetectionMessage(int count) {
+    static const char* const labels[] = { "person", "bicycle", "car", "motorcycle", "bus", "truck" };
+    std::string msg = "{\"detections\":[";
+    for (int i = 0; i < count; i++) {
+        char buf[256];
+        float angle = -80.0f + 160.0f * (i + 0.5f) / count;
+        snprintf(buf, sizeof(buf),
+                 "%s{\"label\":\"%s\",\"confidence\":%.3f,\"angle_deg\":%.3f,\"area\":%.1f,"
+                 "\"bbox\":[%.1f,%.1f,%.1f,%.1f]}",
+                 i ? "," : "", labels[i % 6], 0.5 + 0.01 * i, angle, 1500.0 + 10 * i,
+                 100.0 + i, 80.0, 140.0 + i, 200.0);
+        msg += buf;
+    }
+    msg += "],\"timestamp\":1700000000.123}";
+    return msg;
+}
+
+// Revolutions recorded with --capture, ascended like the live pipeline does
+static std::vector<NodeScan> g_recorded_scans;
+
+static bool loadCapture(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CaptureFileHeader))) {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    const uint8_t* data = static_cast<const uint8_t*>(mapped);
+    size_t size = st.st_size;
+    const CaptureFileHeader* header = reinterpret_cast<const CaptureFileHeader*>(data);
+    bool ok = memcmp(header->magic, CAPTURE_FILE_MAGIC, sizeof(header->magic)) == 0 &&
+              header->version == CAPTURE_FILE_VERSION &&
+              header->node_size == sizeof(sl_lidar_response_measurement_node_hq_t);
+
+    size_t offset = sizeof(CaptureFileHeader);
+    while (ok && offset + sizeof(CaptureRecordHeader) <= size) {
+        const CaptureRecordHeader* record = reinterpret_cast<const CaptureRecordHeader*>(data + offset);
+        if (offset + sizeof(CaptureRecordHeader) + record->size > size) break;
+        const sl_lidar_response_measurement_node_hq_t* nodes =
+            reinterpret_cast<const sl_lidar_response_measurement_node_hq_t*>(data + offset + sizeof(CaptureRecordHeader));
+
+        if (record->type == CAPTURE_NODES) {
+            NodeScan scan(nodes, nodes + record->size / sizeof(*nodes));
+            std::stable_sort(scan.begin(), scan.end(),
+                [](const sl_lidar_response_measurement_node_hq_t& a, const sl_lidar_response_measurement_node_hq_t& b) {
+                    return a.angle_z_q14 < b.angle_z_q14;
+                });
+            g_recorded_scans.push_back(std::move(scan));
+        }
+        offset += sizeof(CaptureRecordHeader) + (record->size + 7) / 8 * 8;
+    }
+
+    munmap(mapped, size);
+    return ok && !g_recorded_scans.empty();
+}
+
+// Start every benchmark from an empty object table
+static void resetTracking() {
+    g_object_count = 0;
+    g_next_track_id = 1;
+}
+
+static void BM_BinScan(benchmark::State& state) {
+    NodeScan nodes = makeSyntheticScan(static_cast<int>(state.range(0)), 1);
+    static ScanBins scan;
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        binScan(g_context, scan, nodes.data(), nodes.size(), BENCH_TIMING);
+        benchmark::DoNotOptimize(scan.cluster_count);
+    }
+    reportAllocations(state, allocations);
+    state.SetItemsProcessed(state.iterations() * nodes.size());
+}
+BENCHMARK(BM_BinScan)->Arg(0)->Arg(5)->Arg(20);
+
+static void BM_BinRecordedScan(benchmark::State& state) {
+    static ScanBins scan;
+    size_t next = 0, nodeCount = 0;
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        const NodeScan& nodes = g_recorded_scans[next];
+        next = (next + 1) % g_recorded_scans.size();
+        binScan(g_context, scan, nodes.data(), nodes.size(), BENCH_TIMING);
+        benchmark::DoNotOptimize(scan.cluster_count);
+        nodeCount += nodes.size();
+    }
+    reportAllocations(state, allocations);
+    state.SetItemsProcessed(nodeCount);
+}
+
+static void BM_ParseDetections(benchmark::State& state) {
+    std::string msg = makeDetectionMessage(static_cast<int>(state.range(0)));
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parseDetections(msg.data(), msg.size()));
+    }
+    reportAllocations(state, allocations);
+}
+BENCHMARK(BM_ParseDetections)->Arg(1)->Arg(10)->Arg(25)->Arg(50);
+
+// Range and track one detection burst per camera frame against a fixed scan
+static void BM_Correlate(benchmark::State& state) {
+    int objects = static_cast<int>(state.range(0));
+    static ScanBins scan, previous;
+    NodeScan nodes = makeSyntheticScan(objects, 2);
+    ScanTiming earlier = BENCH_TIMING;
+    earlier.end_ns -= earlier.period_ns;
+    binScan(g_context, previous, nodes.data(), nodes.size(), earlier);
+    binScan(g_context, scan, nodes.data(), nodes.size(), BENCH_TIMING);
+    std::string msg = makeDetectionMessage(objects);
+    int detectionCount = parseDetections(msg.data(), msg.size());
+
+    resetTracking();
+    uint64_t now_ms = 1000;
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        now_ms += BENCH_FRAME_MS;
+        int measurementCount = rangeDetections(scan, &previous, detectionCount, now_ms * 1000000);
+        updateTracks(measurementCount, now_ms);
+        benchmark::DoNotOptimize(g_object_count);
+    }
+    reportAllocations(state, allocations);
+    checkObjectCount(state, objects);
+}
+BENCHMARK(BM_Correlate)->Arg(1)->Arg(10)->Arg(25)->Arg(MAX_TRACKED_OBJECTS);
+
+static void BM_WriteObjects(benchmark::State& state) {
+    int objects = static_cast<int>(state.range(0));
+    static ScanBins scan;
+    NodeScan nodes = makeSyntheticScan(objects, 3);
+    binScan(g_context, scan, nodes.data(), nodes.size(), BENCH_TIMING);
+    std::string msg = makeDetectionMessage(objects);
+    resetTracking();
+    updateTracks(rangeDetections(scan, nullptr, parseDetections(msg.data(), msg.size()), 0), 1000);
+
+    std::string out;
+    out.reserve(16384);
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        writeObjectsMessage(out, {1700000000123ULL, 1000, 1, true, false});
+        benchmark::DoNotOptimize(out.data());
+    }
+    reportAllocations(state, allocations);
+    checkObjectCount(state, objects);
+    state.counters["bytes"] = out.size();
+}
+BENCHMARK(BM_WriteObjects)->Arg(1)->Arg(10)->Arg(25)->Arg(MAX_TRACKED_OBJECTS);
+
+// Delta against a keyframe with every other object moved past the epsilon
+static void BM_WriteObjectsDelta(benchmark::State& state) {
+    int objects = static_cast<int>(state.range(0));
+    static ScanBins scan;
+    NodeScan nodes = makeSyntheticScan(objects, 3);
+    binScan(g_context, scan, nodes.data(), nodes.size(), BENCH_TIMING);
+    std::string msg = makeDetectionMessage(objects);
+    resetTracking();
+    updateTracks(rangeDetections(scan, nullptr, parseDetections(msg.data(), msg.size()), 0), 1000);
+
+    std::string out;
+    out.reserve(16384);
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        state.PauseTiming();
+        writeObjectsMessage(out, {1700000000123ULL, 1000, 1, false, false});
+        for (int i = 0; i < g_object_count; i += 2) g_objects[i].distance_mm += 2 * DELTA_RANGE_EPSILON_MM;
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(writeObjectsDelta(out, {1700000000123ULL, 1000, 2, false, false},
+                                                   DELTA_RANGE_EPSILON_MM, DELTA_ANGLE_EPSILON_DEG));
+    }
+    reportAllocations(state, allocations);
+    checkObjectCount(state, objects);
+    state.counters["bytes"] = out.size();
+}
+BENCHMARK(BM_WriteObjectsDelta)->Arg(1)->Arg(10)->Arg(MAX_TRACKED_OBJECTS);
+
+// Deskew a full revolution for a turning, moving bike, then bin it. The
+// argument is the mounting: 0 skips the nodes behind, 180 deskews them all.
+static void BM_DeskewScan(benchmark::State& state) {
+    static ScanBins scan;
+    NodeScan source = makeSyntheticScan(10, 7);
+    NodeScan nodes = source;
+    EgoMotion motion = { 30.0f, 5000.0f };
+
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::copy(source.begin(), source.end(), nodes.begin());
+        state.ResumeTiming();
+        deskewScan(nodes.data(), nodes.size(), BENCH_TIMING, motion, static_cast<float>(state.range(0)));
+        binScan(g_context, scan, nodes.data(), nodes.size(), BENCH_TIMING);
+        benchmark::DoNotOptimize(scan.valid_count);
+    }
+    reportAllocations(state, allocations);
+    state.counters["nodes"] = nodes.size();
+}
+BENCHMARK(BM_DeskewScan)->Arg(0)->Arg(180);
+
+// Merge two sensors' scans, front and rear, into the all-round occupancy
+static void BM_FuseOccupancy(benchmark::State& state) {
+    static ScanBins front, rear;
+    static PolarOccupancy grid;
+    NodeScan nodes = makeSyntheticScan(static_cast<int>(state.range(0)), 5);
+    binScan(g_context, front, nodes.data(), nodes.size(), BENCH_TIMING);
+    nodes = makeSyntheticScan(static_cast<int>(state.range(0)), 6);
+    binScan(g_context, rear, nodes.data(), nodes.size(), BENCH_TIMING);
+
+    // One revolution apart, so every iteration pays for a full decay pass
+    uint64_t now_ns = 1;
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        now_ns += SCAN_PERIOD_MS * 1000000ULL;
+        beginOccupancyUpdate(grid, now_ns);
+        fuseScan(grid, front, 0.0f, 0);
+        fuseScan(grid, rear, 180.0f, 1);
+        endOccupancyUpdate(grid, now_ns);
+        benchmark::DoNotOptimize(grid.cells[0].range_mm);
+    }
+    reportAllocations(state, allocations);
+}
+BENCHMARK(BM_FuseOccupancy)->Arg(5)->Arg(20);
+
+// Expire a full object table and refill it each iteration
+static void BM_CleanOldObjects(benchmark::State& state) {
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        uint64_t now_ms = getMonotonicTimeMs();
+        for (int i = 0; i < MAX_TRACKED_OBJECTS; i++) {
+            g_objects[i].last_update_ms = (i % 2) ? now_ms : now_ms - 2 * MAX_OBJECT_AGE_MS;
+        }
+        g_object_count = MAX_TRACKED_OBJECTS;
+        cleanOldObjects();
+        benchmark::DoNotOptimize(g_object_count);
+    }
+    reportAllocations(state, allocations);
+}
+BENCHMARK(BM_CleanOldObjects);
+
+// Pick the alert from a full table of confirmed tracks
+static void BM_SelectAlert(benchmark::State& state) {
+    resetTracking();
+    for (int i = 0; i < MAX_TRACKED_OBJECTS; i++) {
+        DetectedObject& obj = g_objects[i];
+        obj = {};
+        obj.track_id = i + 1;
+        obj.class_id = 1 + i % 8;
+        obj.hits = ALERT_MIN_HITS;
+        obj.distance_mm = 500.0f + 80.0f * i;
+        obj.range.vel = -250.0f * (i % 5);
+    }
+    g_object_count = MAX_TRACKED_OBJECTS;
+
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        uint8_t urgency;
+        benchmark::DoNotOptimize(selectAlertObject(&urgency));
+        benchmark::DoNotOptimize(urgency);
+    }
+    reportAllocations(state, allocations);
+}
+BENCHMARK(BM_SelectAlert);
+
+// ROI hints for the camera from a cluttered scan
+static void BM_BuildRoiHints(benchmark::State& state) {
+    static ScanBins scan;
+    NodeScan nodes = makeSyntheticScan(static_cast<int>(state.range(0)), 8);
+    binScan(g_context, scan, nodes.data(), nodes.size(), BENCH_TIMING);
+    RoiHint hints[MAX_ROI_HINTS];
+
+    uint64_t allocations = g_allocations.load();
+    int count = 0;
+    for (auto _ : state) {
+        count = buildRoiHints(scan, 70.4f, 1280, hints, MAX_ROI_HINTS);
+        benchmark::DoNotOptimize(hints[0].priority);
+    }
+    reportAllocations(state, allocations);
+    state.counters["hints"] = count;
+}
+BENCHMARK(BM_BuildRoiHints)->Arg(5)->Arg(20);
+
+// One flight recorder event, the cost added at each recording point
+static void BM_RecordEvent(benchmark::State& state) {
+    uint32_t value = 0;
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        recordEvent(EVENT_SCAN_GRABBED, 0, value++);
+    }
+    reportAllocations(state, allocations);
+}
+BENCHMARK(BM_RecordEvent);
+
+// One revolution plus one detection burst through every stage: the CPU cost
+// per scan of the whole core, less the ZMQ sends
+static void BM_FullPipeline(benchmark::State& state) {
+    int objects = static_cast<int>(state.range(0));
+    static ScanBins scan;
+    NodeScan nodes = makeSyntheticScan(objects, 4);
+    std::string msg = makeDetectionMessage(objects);
+    std::string out;
+    out.reserve(16384);
+
+    resetTracking();
+    uint64_t now_ms = 1000;
+    uint64_t allocations = g_allocations.load();
+    for (auto _ : state) {
+        binScan(g_context, scan, nodes.data(), nodes.size(), BENCH_TIMING);
+        int detectionCount = parseDetections(msg.data(), msg.size());
+        now_ms += BENCH_FRAME_MS;
+        updateTracks(rangeDetections(scan, nullptr, detectionCount, now_ms * 1000000), now_ms);
+        writeObjectsMessage(out, {now_ms, now_ms, 1, true, false});
+        benchmark::DoNotOptimize(out.data());
+    }
+    reportAllocations(state, allocations);
+    checkObjectCount(state, objects);
+}
+BENCHMARK(BM_FullPipeline)->Arg(1)->Arg(10)->Arg(MAX_TRACKED_OBJECTS);
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    initClassTable();
+
+    // Anything Google Benchmark did not consume is a capture file
+    for (int i = 1; i < argc; i++) {
+        if (loadCapture(argv[i])) {
+            fprintf(stderr, "Loaded %zu recorded scans from %s\n", g_recorded_scans.size(), argv[i]);
+            benchmark::RegisterBenchmark("BM_BinRecordedScan", BM_BinRecordedScan);
+        } else {
+            fprintf(stderr, "Not a usable capture file: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -9,6 +9,7 @@ import zmq
 import json
 import time
 import math
+import struct
 import psutil  # Add this for CPU affinity control
 
 from hailo_apps_infra.hailo_rpi_common import (
@@ -71,6 +72,24 @@ DEBUG_ANGLES = False       # Keep debug disabled for performance
 BATCH_PROCESSING = True    # Enable batch processing of detections
 USE_CUDA = False          # Disable CUDA to reduce CPU overhead
 ENABLE_THREADING = False   # Disable threading to reduce overhead
+BINARY_DETECTIONS = False  # Publish packed DBIN frames instead of JSON (needs a DBIN-aware lidar_zmq_refined)
+
+# Binary detection frame layout, must match DetectionFrameHeader/DetectionRecord in lidar_zmq_refined.cpp
+DETECTION_FRAME_MAGIC = b"DBIN"
+DETECTION_FRAME_VERSION = 1
+DETECTION_FRAME_HEADER = struct.Struct("<4sHHIIQ")  # magic, version, count, frame, reserved, timestamp_us
+DETECTION_RECORD = struct.Struct("<fff16s")         # confidence, angle_deg, area, label
+
+# LiDAR region-of-interest hints, must match RoiFrameHeader/RoiHint in lidar_core.h
+ROI_HINTS_ENABLED = True
+ROI_HINT_ENDPOINT = "tcp://localhost:5560"
+ROI_FRAME_MAGIC = b"ROIH"
+ROI_FRAME_VERSION = 1
+ROI_FRAME_HEADER = struct.Struct("<4sHHIIQ")  # magic, version, count, sequence, reserved, timestamp_us
+ROI_HINT = struct.Struct("<fffHHB3x")          # min/max angle_deg, range_mm, column_min/max, priority
+ROI_HINT_MAX_AGE = 0.3          # Older hints are ignored and every frame is processed
+IDLE_PROCESS_INTERVAL = 0.2     # Process at 5fps while the LiDAR sees nothing in range
+ROI_CONFIDENCE_THRESHOLD = 0.3  # Lower bar for detections overlapping a hinted region
 
 # GStreamer pipeline optimization
 GST_PIPELINE_FLAGS = {
@@ -154,6 +173,18 @@ class user_app_callback_class(app_callback_class):
         
         self.socket.bind("tcp://*:5555")
         print("ZMQ publisher started on port 5555")
+
+        # Latest ROI hints from lidar_zmq_refined, as (column_min, column_max, priority)
+        self.roi_socket = None
+        self.roi_hints = []
+        self.roi_time = 0.0
+        if ROI_HINTS_ENABLED:
+            self.roi_socket = self.context.socket(zmq.SUB)
+            self.roi_socket.setsockopt(zmq.CONFLATE, 1)
+            self.roi_socket.setsockopt(zmq.LINGER, 0)
+            self.roi_socket.connect(ROI_HINT_ENDPOINT)
+            self.roi_socket.setsockopt(zmq.SUBSCRIBE, ROI_FRAME_MAGIC)
+            print(f"Subscribed to LiDAR ROI hints on {ROI_HINT_ENDPOINT}")
         self.last_process_time = time.time()
         self.camera_hfov = compute_horizontal_fov(DIAGONAL_FOV_DEG, ASPECT_WIDTH, ASPECT_HEIGHT)
         print(f"Camera horizontal FOV: {self.camera_hfov:.1f}°")
@@ -162,7 +193,34 @@ class user_app_callback_class(app_callback_class):
         self.angle_scale = (self.camera_hfov/2) / (IMAGE_WIDTH/2)
         self.image_center = IMAGE_WIDTH / 2.0
 
+    def poll_roi_hints(self):
+        """Take the newest ROI hint message, if one arrived since the last frame."""
+        if self.roi_socket is None:
+            return
+        try:
+            msg = self.roi_socket.recv(zmq.NOBLOCK)
+        except zmq.error.Again:
+            return
+        if len(msg) < ROI_FRAME_HEADER.size:
+            return
+        magic, version, count, _, _, _ = ROI_FRAME_HEADER.unpack_from(msg)
+        if magic != ROI_FRAME_MAGIC or version != ROI_FRAME_VERSION or \
+                len(msg) < ROI_FRAME_HEADER.size + count * ROI_HINT.size:
+            return
+        hints = []
+        for i in range(count):
+            _, _, _, col_min, col_max, priority = ROI_HINT.unpack_from(
+                msg, ROI_FRAME_HEADER.size + i * ROI_HINT.size)
+            hints.append((col_min, col_max, priority))
+        self.roi_hints = hints
+        self.roi_time = time.time()
+
+    def hints_fresh(self, now):
+        return self.roi_socket is not None and now - self.roi_time < ROI_HINT_MAX_AGE
+
     def __del__(self):
+        if hasattr(self, 'roi_socket') and self.roi_socket is not None:
+            self.roi_socket.close()
         if hasattr(self, 'socket'):
             self.socket.close()
         if hasattr(self, 'context'):
@@ -209,9 +267,13 @@ def app_callback(pad, info, user_data):
     if buffer is None:
         return Gst.PadProbeReturn.OK
 
-    # Check processing interval (throttle to 20fps)
+    # Check processing interval (throttle to 20fps, or lower while the LiDAR
+    # reports nothing in range)
     current_time = time.time()
-    if current_time - user_data.last_process_time < PROCESS_INTERVAL:
+    user_data.poll_roi_hints()
+    hints = user_data.roi_hints if user_data.hints_fresh(current_time) else None
+    interval = IDLE_PROCESS_INTERVAL if hints == [] else PROCESS_INTERVAL
+    if current_time - user_data.last_process_time < interval:
         return Gst.PadProbeReturn.OK
     user_data.last_process_time = current_time
 
@@ -227,9 +289,9 @@ def app_callback(pad, info, user_data):
     angle_scale = user_data.angle_scale
     
     for detection in detections:
-        # Quick confidence check first
+        # Quick confidence check first; where the LiDAR sees something the bar is lower
         confidence = detection.get_confidence()
-        if confidence < CONFIDENCE_THRESHOLD:
+        if confidence < ROI_CONFIDENCE_THRESHOLD or (confidence < CONFIDENCE_THRESHOLD and not hints):
             continue
 
         bbox = detection.get_bbox()
@@ -237,6 +299,16 @@ def app_callback(pad, info, user_data):
         # Compute bbox coordinates more efficiently
         x_min = float(bbox.xmin()) * IMAGE_WIDTH
         x_max = float(bbox.xmax()) * IMAGE_WIDTH
+
+        # Most urgent ROI hint the box overlaps, 0 for none
+        roi_priority = 0
+        if hints:
+            for col_min, col_max, priority in hints:
+                if x_min <= col_max and x_max >= col_min:
+                    roi_priority = priority
+                    break
+            if confidence < CONFIDENCE_THRESHOLD and roi_priority == 0:
+                continue
         
         # Quick area check using only width (faster than full area)
         width = x_max - x_min
@@ -273,9 +345,28 @@ def app_callback(pad, info, user_data):
             'angle_deg': angle_deg,
             'area': area,
             'bbox': [x_min, y_min, x_max, y_max],
-            'track_id': track_id
+            'track_id': track_id,
+            'roi_priority': roi_priority
         })
 
+    # Hinted detections first, so they survive the correlator's per-message limit
+    if hints:
+        detection_list.sort(key=lambda det: det['roi_priority'], reverse=True)
+
+    if BINARY_DETECTIONS:
+        # Packed frame: fixed header followed by one record per detection
+        payload = bytearray(DETECTION_FRAME_HEADER.pack(
+            DETECTION_FRAME_MAGIC, DETECTION_FRAME_VERSION, len(detection_list),
+            user_data.get_count() & 0xFFFFFFFF, 0, int(current_time * 1e6)))
+        for det in detection_list:
+            payload += DETECTION_RECORD.pack(det['confidence'], det['angle_deg'], det['area'],
+                                             det['label'].encode('ascii', 'replace')[:16])
+        try:
+            user_data.socket.send(bytes(payload), zmq.NOBLOCK)
+        except zmq.error.Again:
+            pass
+        return Gst.PadProbeReturn.OK
+
     # Always publish via ZMQ, even if detection_list is empty
     message = {
         'timestamp': current_time,
@@ -3,6 +3,11 @@ import serial
 import time
 import zmq
 import json
+import struct
+
+# Camera-only alert path. lidar_zmq_refined writes fused, LiDAR-ranged
+# alerts to the same port itself (alert_port in its --config). Both lock the
+# port exclusively, so whichever starts second refuses to share it.
 
 # Serial port and baud rate for ESP32
 SERIAL_PORT = '/dev/esp32'
@@ -11,8 +16,62 @@ BAUD_RATE = 115200
 # ZMQ connection details
 ZMQ_ADDRESS = "tcp://localhost:5555" # Assuming the publisher is on the same machine
 
+# Binary detection frames (docker_detection_refined.py with BINARY_DETECTIONS)
+DETECTION_FRAME_MAGIC = b"DBIN"
+DETECTION_FRAME_HEADER = struct.Struct("<4sHHIIQ")
+DETECTION_RECORD = struct.Struct("<fff16s")
+
+# Compact alert packet forwarded to the helmet ESP32 (alert_packet in
+# esp32_wireless.ino): magic, version, class_id, urgency, distance_cm, sequence
+ALERT_PACKET = struct.Struct("<BBBBHH")
+ALERT_PACKET_MAGIC = 0xA5
+ALERT_PACKET_VERSION = 1
+
+# Class IDs, in the same order as CLASS_LABELS in lidar_core.h
+CLASS_LABELS = [
+    "unknown",
+    "person", "bicycle", "car", "motorcycle", "airplane", "bus",
+    "train", "truck", "boat", "traffic light", "fire hydrant", "street sign",
+    "stop sign", "parking meter", "bench", "bird", "cat", "dog",
+    "horse", "sheep", "cow", "elephant", "bear", "zebra",
+    "giraffe", "hat", "backpack", "umbrella", "shoe", "eye glasses",
+    "handbag", "tie", "suitcase", "frisbee", "skis", "snowboard",
+    "sports ball", "kite", "baseball bat", "baseball glove", "skateboard", "surfboard",
+    "tennis racket", "bottle", "plate", "wine glass", "cup", "fork",
+    "knife", "spoon", "bowl", "banana", "apple", "sandwich",
+    "orange", "broccoli", "carrot", "hot dog", "pizza", "donut",
+    "cake", "chair", "couch", "potted plant", "bed", "mirror",
+    "dining table", "window", "desk", "toilet", "door", "tv",
+    "laptop", "mouse", "remote", "keyboard", "cell phone", "microwave",
+    "oven", "toaster", "sink", "refrigerator", "blender", "book",
+    "clock", "vase", "scissors", "teddy bear", "hair drier", "toothbrush",
+    "hair brush",
+]
+CLASS_IDS = {label: class_id for class_id, label in enumerate(CLASS_LABELS)}
+
+def alert_packet(class_id, sequence, urgency=0, distance_cm=0):
+    """Encode one compact alert; urgency and range are unknown from camera labels alone"""
+    return ALERT_PACKET.pack(ALERT_PACKET_MAGIC, ALERT_PACKET_VERSION, class_id,
+                             urgency, distance_cm, sequence & 0xFFFF)
+
+def first_detection_label(raw):
+    """Label of the first detection in a JSON or DBIN message ("" if it has none), or None without detections"""
+    if raw.startswith(DETECTION_FRAME_MAGIC):
+        count = DETECTION_FRAME_HEADER.unpack_from(raw)[2]
+        if count == 0:
+            return None
+        label = DETECTION_RECORD.unpack_from(raw, DETECTION_FRAME_HEADER.size)[3]
+        return label.rstrip(b'\0').decode('ascii', 'replace')
+    message = json.loads(raw)
+    if 'detections' in message and message['detections']:
+        return message['detections'][0].get('label') or ""
+    return None
+
 print(f"Initializing serial connection to {SERIAL_PORT} at {BAUD_RATE} baud...")
-ser = serial.Serial(SERIAL_PORT, BAUD_RATE, timeout=1)
+try:
+    ser = serial.Serial(SERIAL_PORT, BAUD_RATE, timeout=1, exclusive=True)
+except serial.SerialException as e:
+    raise SystemExit(f"Cannot own {SERIAL_PORT} ({e}); is lidar_zmq_refined sending alerts to it?")
 print("Serial connection established.")
 
 print(f"Connecting to ZMQ publisher at {ZMQ_ADDRESS}...")
@@ -46,10 +105,11 @@ try:
     # --- ORIGINAL ZMQ LOOP (UNCOMMENTED) ---
     print("Listening for detection messages...")
     message_counter = 0 # Initialize message counter
+    alert_sequence = 0
     while True:
         try:
             # Try to receive a message without blocking indefinitely
-            message_str = socket.recv_string(flags=zmq.NOBLOCK)
+            message_raw = socket.recv(flags=zmq.NOBLOCK)
             message_counter += 1 # Increment counter for every received message
             
             # --- Process only every 3rd message ---
@@ -63,26 +123,26 @@ try:
             
             # --- Original processing logic for the 3rd message ---
             try:
-                message = json.loads(message_str)
-                # print(f"Parsed message: {message}") # Optional: Debug print
-
-                if 'detections' in message and message['detections']:
-                    # Get the label from the first detection
-                    first_detection = message['detections'][0]
-                    label = first_detection.get('label')
+                # Get the label from the first detection
+                label = first_detection_label(message_raw)
 
+                if label is not None:
                     if label:
                         print(f"(Msg {message_counter // 3}) Detected object: {label}. Preparing to send to ESP32...") # Modified print
-                        # Prepare the string to send
-                        string_to_send = label + "\n"
-                        encoded_data = string_to_send.encode('utf-8')
-                       
+                        class_id = CLASS_IDS.get(label)
+                        if class_id is not None:
+                            # Known classes go out as a compact packet
+                            alert_sequence += 1
+                            encoded_data = alert_packet(class_id, alert_sequence)
+                        else:
+                            # Anything else as the label followed by a newline character
+                            encoded_data = (label + "\n").encode('utf-8')
+
                         # --- DEBUG PRINT ---
-                        print(f"Attempting to send: '{string_to_send.replace("\\n", "\\\\n")}' (Length: {len(encoded_data)} bytes)") 
-                       
-                        # Send the label followed by a newline character
+                        print(f"Attempting to send: {encoded_data!r} (Length: {len(encoded_data)} bytes)")
+
                         ser.write(encoded_data)
-                        print("Label sent.")
+                        print("Alert sent.")
                        
                         # --- RATE LIMITING DELAY ---
                         # time.sleep(0.1) # We might not need the delay anymore, comment out for now
@@ -92,7 +152,7 @@ try:
                     # print("No detections found in message.")
 
             except json.JSONDecodeError:
-                print(f"Error decoding JSON: {message_str}")
+                print(f"Error decoding JSON: {message_raw}")
             except KeyError as e:
                 print(f"Missing key in message structure: {e}")
             except Exception as e:
@@ -18,6 +18,13 @@ typedef struct struct_message {
 
 struct_message message;
 
+// Compact alert packets (see alert_packet in esp32_wireless.ino) arrive on
+// serial as 8 raw bytes starting with ALERT_PACKET_MAGIC, which is never
+// part of a label, and are forwarded to the receiver unchanged
+#define ALERT_PACKET_MAGIC 0xA5
+#define ALERT_PACKET_SIZE 8
+uint8_t alertPacket[ALERT_PACKET_SIZE];
+
 // ESP-NOW Send Callback Function (Optional but good practice)
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
     Serial.print("\\r\\nLast Packet Send Status:\\t");
@@ -57,6 +64,7 @@ int button2State = HIGH;             // Confirmed STABLE state after debounce
 
 void setup() {
     Serial.begin(115200); 
+    Serial.setTimeout(50); // Bounds the wait for the rest of an alert packet
     Serial.println("--- Checkpoint 1: Serial Started ---"); 
     // Original messages moved after checkpoints for clarity
     // Serial.println("ESP32 Tethered Sender Starting...");
@@ -117,7 +125,13 @@ void loop() {
     if (Serial.available() > 0) {
         char incomingByte = Serial.read();
 
-        if (incomingByte == '\n') { // End of message detected
+        if ((uint8_t)incomingByte == ALERT_PACKET_MAGIC) {
+            // The rest of the packet follows immediately; an interrupted one is dropped
+            alertPacket[0] = ALERT_PACKET_MAGIC;
+            if (Serial.readBytes(alertPacket + 1, ALERT_PACKET_SIZE - 1) == ALERT_PACKET_SIZE - 1) {
+                esp_now_send(receiverAddress, alertPacket, ALERT_PACKET_SIZE);
+            }
+        } else if (incomingByte == '\n') { // End of message detected
             if (serialBufferIndex > 0) { // We have a complete message
                 serialBuffer[serialBufferIndex] = '\0'; // Null terminate
                 // Serial.print("Received complete label from RPi: '"); // Keep prints minimal for now
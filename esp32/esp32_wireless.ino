@@ -10,7 +10,9 @@
 #define LED_PIN_2 19 // GPIO Data Pin
 #define NUM_LEDS 4 // num of LEDS per strip
 #define BLINK_DURATION 5000 // 5 seconds blink duration
+#define BLINK_PERIOD 1000 // one on/off cycle
 #define BRIGHTNESS 100 // brightness
+#define FRAME_MS 20 // loop() renders the strips at least this often
 
 
 Adafruit_NeoPixel strip1(NUM_LEDS, LED_PIN_1, NEO_GRB + NEO_KHZ800);
@@ -34,538 +36,392 @@ typedef struct struct_message {
 struct_message message;
 
 
-// Add at the top with other defines
-#define AUDIO_DEBOUNCE_TIME 2000  // 2 seconds minimum between audio plays
-unsigned long lastAudioPlayTime = 0;  // Track last time audio was played
-
-
-// --- Add this global variable ---
-char lastPlayedLabel[MAX_LABEL_LENGTH] = ""; // Store the last label played
+// Compact alert packet sent by the host for each alert, 8 bytes instead of the
+// 40-byte struct_message. Both ends are little-endian. struct_message is
+// still accepted (told apart by length) while senders are being updated.
+#define ALERT_PACKET_MAGIC 0xA5   // Not a printable character, so it also frames packets on serial
+#define ALERT_PACKET_VERSION 1
+typedef struct __attribute__((packed)) alert_packet {
+    uint8_t magic;         // ALERT_PACKET_MAGIC
+    uint8_t version;       // ALERT_PACKET_VERSION
+    uint8_t class_id;      // The host's class ID, an index into CLASS_ACTIONS
+    uint8_t urgency;       // 0 (informational) to 255 (critical)
+    uint16_t distance_cm;  // Range to the object, 0 when unknown
+    uint16_t sequence;     // Incremented per alert; a repeat is a retransmission
+} alert_packet;
+static_assert(sizeof(alert_packet) == 8, "alert_packet layout changed");
+
+uint16_t lastAlertSequence = 0;
+bool haveAlertSequence = false;
+
+
+// Audio scheduling: alerts wait in a small queue ordered by urgency. Each
+// class has its own debounce window, and a more urgent alert cuts off the
+// track that is playing instead of waiting for it to finish.
+#define AUDIO_DEBOUNCE_TIME 2000     // Per-class gap between plays for people and animals
+#define AUDIO_DEBOUNCE_HAZARD 1500   // ... for vehicles
+#define AUDIO_DEBOUNCE_SCENERY 5000  // ... for everything else
+#define AUDIO_QUEUE_SIZE 4           // Pending alerts; the least urgent is dropped when full
+#define AUDIO_ALERT_MAX_AGE 1000     // Pending alerts older than this are dropped as stale
+#define AUDIO_TRACK_TIMEOUT 10000    // Assume a track is over if the DFPlayer never reports it
+#define ALERT_URGENCY_CRITICAL 192   // Alerts at least this urgent skip their class's debounce
+#define ALERT_URGENCY_LEGACY 0       // Urgency given to label packets, which carry none
+
+struct PendingAlert {
+    uint8_t class_id;
+    uint8_t urgency;
+    unsigned long received_ms;
+};
+
+PendingAlert audioQueue[AUDIO_QUEUE_SIZE];
+int audioQueueCount = 0;
 
 
 // --- Add this global flag ---
-volatile bool isAudioPlaying = false; // Track if we expect audio to be playing
-
+bool isAudioPlaying = false; // Track if we expect audio to be playing
+uint8_t playingClass = 0;    // Class and urgency of the track playing
+uint8_t playingUrgency = 0;
+unsigned long playingSince = 0;
+
+
+// --- LED Animation ---
+// Each strip runs its own blink animation, rendered from loop() by
+// renderAnimation() instead of delay()ing. Starting a new animation
+// replaces the current one, so it shows from the next frame.
+struct StripAnimation {
+    Adafruit_NeoPixel* strip;
+    uint32_t color;
+    unsigned long start_ms;
+    unsigned long duration_ms;  // 0 when idle
+    unsigned long period_ms;
+    bool lit;                   // What the strip shows right now
+};
+
+StripAnimation animation1 = { &strip1, 0, 0, 0, BLINK_PERIOD, false };
+StripAnimation animation2 = { &strip2, 0, 0, 0, BLINK_PERIOD, false };
+
+void startBlink(StripAnimation &animation, uint32_t color, unsigned long duration_ms) {
+    animation.color = color;
+    animation.start_ms = millis();
+    animation.duration_ms = duration_ms;
+    animation.period_ms = BLINK_PERIOD;
+    animation.strip->fill(color);  // Light up at once rather than on the next frame
+    animation.strip->show();
+    animation.lit = true;
+}
 
-// --- LED Functions ---
-void blinkLED(Adafruit_NeoPixel &strip, uint32_t color) {
-    unsigned long startTime = millis();
-    while (millis() - startTime < BLINK_DURATION) {
-        for (int i = 0; i < NUM_LEDS; i++) {
-            strip.setPixelColor(i, color);
+// Bring the strip up to date; it is only rewritten when it changes
+void renderAnimation(StripAnimation &animation, unsigned long now) {
+    bool lit = false;
+    if (animation.duration_ms != 0) {
+        unsigned long elapsed = now - animation.start_ms;
+        if (elapsed >= animation.duration_ms) {
+            animation.duration_ms = 0;
+        } else {
+            lit = (elapsed % animation.period_ms) < animation.period_ms / 2;
         }
-        strip.show();
-        delay(500);
-
-        for (int i = 0; i < NUM_LEDS; i++) {
-            strip.setPixelColor(i, 0);
+    }
+    if (lit != animation.lit) {
+        if (lit) {
+            animation.strip->fill(animation.color);
+        } else {
+            animation.strip->clear();
         }
-        strip.show();
-        delay(500);
+        animation.strip->show();
+        animation.lit = lit;
     }
 }
 
-// --- Audio & Action Mapping ---
-void playAudioForLabel(const char* label) {
-    Serial.print("Processing label: ");
-    Serial.println(label);
+// --- Class Table ---
+// Class IDs are the host's CLASS_LABELS indices (lidar_core.h, COCO order),
+// so compact packets index this table directly. Audio files are named by
+// track number on the DFPlayer SD card.
+enum LedPattern : uint8_t {
+    LED_NONE,    // Audio only
+    LED_HAZARD,  // Blink both strips
+};
+
+struct ClassAction {
+    const char* label;  // Detection label, for legacy packets and logging
+    uint8_t track;      // DFPlayer track, 0 for none
+    LedPattern led;
+    uint16_t debounce_ms;  // Shortest gap between two plays of this class's track
+};
+
+constexpr ClassAction CLASS_ACTIONS[] = {
+    {"unknown", 0, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"person", 1, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"bicycle", 2, LED_HAZARD, AUDIO_DEBOUNCE_HAZARD},
+    {"car", 3, LED_HAZARD, AUDIO_DEBOUNCE_HAZARD},
+    {"motorcycle", 4, LED_HAZARD, AUDIO_DEBOUNCE_HAZARD},
+    {"airplane", 5, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"bus", 6, LED_HAZARD, AUDIO_DEBOUNCE_HAZARD},
+    {"train", 7, LED_HAZARD, AUDIO_DEBOUNCE_HAZARD},
+    {"truck", 8, LED_HAZARD, AUDIO_DEBOUNCE_HAZARD},
+    {"boat", 9, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"traffic light", 10, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"fire hydrant", 11, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"street sign", 12, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"stop sign", 13, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"parking meter", 14, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"bench", 15, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"bird", 16, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"cat", 17, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"dog", 18, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"horse", 19, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"sheep", 20, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"cow", 21, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"elephant", 22, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"bear", 23, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"zebra", 24, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"giraffe", 25, LED_NONE, AUDIO_DEBOUNCE_TIME},
+    {"hat", 26, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"backpack", 27, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"umbrella", 28, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"shoe", 29, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"eye glasses", 30, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"handbag", 31, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"tie", 32, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"suitcase", 33, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"frisbee", 34, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"skis", 35, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"snowboard", 36, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"sports ball", 37, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"kite", 38, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"baseball bat", 39, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"baseball glove", 40, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"skateboard", 41, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"surfboard", 42, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"tennis racket", 43, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"bottle", 44, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"plate", 45, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"wine glass", 46, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"cup", 47, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"fork", 48, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"knife", 49, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"spoon", 50, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"bowl", 51, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"banana", 52, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"apple", 53, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"sandwich", 54, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"orange", 55, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"broccoli", 56, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"carrot", 57, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"hot dog", 58, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"pizza", 59, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"donut", 60, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"cake", 61, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"chair", 62, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"couch", 63, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"potted plant", 64, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"bed", 65, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"mirror", 66, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"dining table", 67, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"window", 68, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"desk", 69, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"toilet", 70, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"door", 71, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"tv", 72, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"laptop", 73, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"mouse", 74, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"remote", 75, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"keyboard", 76, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"cell phone", 77, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"microwave", 78, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"oven", 79, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"toaster", 80, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"sink", 81, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"refrigerator", 82, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"blender", 83, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"book", 84, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"clock", 85, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"vase", 86, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"scissors", 87, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"teddy bear", 88, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"hair drier", 89, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"toothbrush", 90, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+    {"hair brush", 91, LED_NONE, AUDIO_DEBOUNCE_SCENERY},
+};
+constexpr int NUM_CLASSES = sizeof(CLASS_ACTIONS) / sizeof(CLASS_ACTIONS[0]);
+constexpr uint8_t CLASS_UNKNOWN = 0;
+static_assert(NUM_CLASSES == 92, "CLASS_ACTIONS must match the host's CLASS_LABELS");
+
+// Legacy label packets: open-addressed label -> class ID table, the same
+// FNV-1a scheme the host uses, filled once in setup()
+#define CLASS_TABLE_SIZE 256
+uint8_t classTable[CLASS_TABLE_SIZE];
+
+uint32_t hashLabel(const char* label) {
+    uint32_t hash = 2166136261u;
+    for (const char* c = label; *c; c++) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+    }
+    return hash;
+}
 
-    // --- Check if player is currently supposed to be playing ---
-    if (isAudioPlaying) {
-        Serial.println("Skipping audio - Waiting for previous track to finish.");
-        return;
+void initClassTable() {
+    memset(classTable, CLASS_UNKNOWN, sizeof(classTable));
+    for (int id = 1; id < NUM_CLASSES; id++) {
+        uint32_t slot = hashLabel(CLASS_ACTIONS[id].label) % CLASS_TABLE_SIZE;
+        while (classTable[slot] != CLASS_UNKNOWN) slot = (slot + 1) % CLASS_TABLE_SIZE;
+        classTable[slot] = id;
     }
+}
 
-    // --- Check if same as last label ---
-    if (strcmp(label, lastPlayedLabel) == 0) {
-        Serial.println("Skipping audio - same as last played label");
-        return;
+uint8_t lookupClassId(const char* label) {
+    uint32_t slot = hashLabel(label) % CLASS_TABLE_SIZE;
+    while (classTable[slot] != CLASS_UNKNOWN) {
+        if (strcmp(CLASS_ACTIONS[classTable[slot]].label, label) == 0) return classTable[slot];
+        slot = (slot + 1) % CLASS_TABLE_SIZE;
     }
+    return CLASS_UNKNOWN;
+}
 
-    // --- Check time debounce ---
-    unsigned long currentTime = millis();
-    if (currentTime - lastAudioPlayTime < AUDIO_DEBOUNCE_TIME) {
-        Serial.println("Skipping audio - too soon since last play");
-        return;
-    }
+// --- Audio & Action Mapping ---
+unsigned long lastPlayedMs[NUM_CLASSES]; // millis() of each class's last play
+bool playedOnce[NUM_CLASSES];
 
-    // --- If we get here, we will attempt to play ---
-    bool playCommandSent = false; // Flag to track if play command was sent in this call
+// Add an alert to the audio queue. A class already waiting is merged into
+// one entry; when the queue is full the least urgent alert makes way.
+void queueAudio(uint8_t classId, uint8_t urgency) {
+    const ClassAction& action = CLASS_ACTIONS[classId];
+    Serial.print("Processing class: ");
+    Serial.println(action.label);
 
-    // Map labels to audio tracks
-    if (strcmp(label, "person") == 0) {
-        Serial.println("Playing track 1 (person)");
-        player.play(1);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "bicycle") == 0) {
-        Serial.println("Playing track 2 (bicycle)");
-        player.play(2);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "car") == 0) {
-        Serial.println("Playing track 3 (car)");
-        player.play(3);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "motorcycle") == 0) {
-        Serial.println("Playing track 4 (motorcycle)");
-        player.play(4);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "airplane") == 0) {
-        Serial.println("Playing track 5 (airplane)");
-        player.play(5);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "bus") == 0) {
-        Serial.println("Playing track 6 (bus)");
-        player.play(6);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "train") == 0) {
-        Serial.println("Playing track 7 (train)");
-        player.play(7);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "truck") == 0) {
-        Serial.println("Playing track 8 (truck)");
-        player.play(8);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "boat") == 0) {
-        Serial.println("Playing track 9 (boat)");
-        player.play(9);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "traffic light") == 0) {
-        Serial.println("Playing track 10 (traffic light)");
-        player.play(10);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "fire hydrant") == 0) {
-        Serial.println("Playing track 11 (fire hydrant)");
-        player.play(11);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "street sign") == 0) {
-        Serial.println("Playing track 12 (street sign)");
-        player.play(12);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "stop sign") == 0) {
-        Serial.println("Playing track 13 (stop sign)");
-        player.play(13);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "parking meter") == 0) {
-        Serial.println("Playing track 14 (parking meter)");
-        player.play(14);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "bench") == 0) {
-        Serial.println("Playing track 15 (bench)");
-        player.play(15);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "bird") == 0) {
-        Serial.println("Playing track 16 (bird)");
-        player.play(16);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "cat") == 0) {
-        Serial.println("Playing track 17 (cat)");
-        player.play(17);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "dog") == 0) {
-        Serial.println("Playing track 18 (dog)");
-        player.play(18);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "horse") == 0) {
-        Serial.println("Playing track 19 (horse)");
-        player.play(19);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "sheep") == 0) {
-        Serial.println("Playing track 20 (sheep)");
-        player.play(20);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "cow") == 0) {
-        Serial.println("Playing track 21 (cow)");
-        player.play(21);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "elephant") == 0) {
-        Serial.println("Playing track 22 (elephant)");
-        player.play(22);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "bear") == 0) {
-        Serial.println("Playing track 23 (bear)");
-        player.play(23);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "zebra") == 0) {
-        Serial.println("Playing track 24 (zebra)");
-        player.play(24);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "giraffe") == 0) {
-        Serial.println("Playing track 25 (giraffe)");
-        player.play(25);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "hat") == 0) {
-        Serial.println("Playing track 26 (hat)");
-        player.play(26);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "backpack") == 0) {
-        Serial.println("Playing track 27 (backpack)");
-        player.play(27);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "umbrella") == 0) {
-        Serial.println("Playing track 28 (umbrella)");
-        player.play(28);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "shoe") == 0) {
-        Serial.println("Playing track 29 (shoe)");
-        player.play(29);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "eye glasses") == 0) {
-        Serial.println("Playing track 30 (eye glasses)");
-        player.play(30);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "handbag") == 0) {
-        Serial.println("Playing track 31 (handbag)");
-        player.play(31);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "tie") == 0) {
-        Serial.println("Playing track 32 (tie)");
-        player.play(32);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "suitcase") == 0) {
-        Serial.println("Playing track 33 (suitcase)");
-        player.play(33);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "frisbee") == 0) {
-        Serial.println("Playing track 34 (frisbee)");
-        player.play(34);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "skis") == 0) {
-        Serial.println("Playing track 35 (skis)");
-        player.play(35);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "snowboard") == 0) {
-        Serial.println("Playing track 36 (snowboard)");
-        player.play(36);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "sports ball") == 0) {
-        Serial.println("Playing track 37 (sports ball)");
-        player.play(37);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "kite") == 0) {
-        Serial.println("Playing track 38 (kite)");
-        player.play(38);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "baseball bat") == 0) {
-        Serial.println("Playing track 39 (baseball bat)");
-        player.play(39);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "baseball glove") == 0) {
-        Serial.println("Playing track 40 (baseball glove)");
-        player.play(40);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "skateboard") == 0) {
-        Serial.println("Playing track 41 (skateboard)");
-        player.play(41);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "surfboard") == 0) {
-        Serial.println("Playing track 42 (surfboard)");
-        player.play(42);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "tennis racket") == 0) {
-        Serial.println("Playing track 43 (tennis racket)");
-        player.play(43);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "bottle") == 0) {
-        Serial.println("Playing track 44 (bottle)");
-        player.play(44);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "plate") == 0) {
-        Serial.println("Playing track 45 (plate)");
-        player.play(45);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "wine glass") == 0) {
-        Serial.println("Playing track 46 (wine glass)");
-        player.play(46);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "cup") == 0) {
-        Serial.println("Playing track 47 (cup)");
-        player.play(47);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "fork") == 0) {
-        Serial.println("Playing track 48 (fork)");
-        player.play(48);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "knife") == 0) {
-        Serial.println("Playing track 49 (knife)");
-        player.play(49);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "spoon") == 0) {
-        Serial.println("Playing track 50 (spoon)");
-        player.play(50);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "bowl") == 0) {
-        Serial.println("Playing track 51 (bowl)");
-        player.play(51);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "banana") == 0) {
-        Serial.println("Playing track 52 (banana)");
-        player.play(52);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "apple") == 0) {
-        Serial.println("Playing track 53 (apple)");
-        player.play(53);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "sandwich") == 0) {
-        Serial.println("Playing track 54 (sandwich)");
-        player.play(54);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "orange") == 0) {
-        Serial.println("Playing track 55 (orange)");
-        player.play(55);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "broccoli") == 0) {
-        Serial.println("Playing track 56 (broccoli)");
-        player.play(56);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "carrot") == 0) {
-        Serial.println("Playing track 57 (carrot)");
-        player.play(57);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "hot dog") == 0) {
-        Serial.println("Playing track 58 (hot dog)");
-        player.play(58);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "pizza") == 0) {
-        Serial.println("Playing track 59 (pizza)");
-        player.play(59);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "donut") == 0) {
-        Serial.println("Playing track 60 (donut)");
-        player.play(60);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "cake") == 0) {
-        Serial.println("Playing track 61 (cake)");
-        player.play(61);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "chair") == 0) {
-        Serial.println("Playing track 62 (chair)");
-        player.play(62);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "couch") == 0) {
-        Serial.println("Playing track 63 (couch)");
-        player.play(63);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "potted plant") == 0) {
-        Serial.println("Playing track 64 (potted plant)");
-        player.play(64);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "bed") == 0) {
-        Serial.println("Playing track 65 (bed)");
-        player.play(65);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "mirror") == 0) {
-        Serial.println("Playing track 66 (mirror)");
-        player.play(66);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "dining table") == 0) {
-        Serial.println("Playing track 67 (dining table)");
-        player.play(67);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "window") == 0) {
-        Serial.println("Playing track 68 (window)");
-        player.play(68);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "desk") == 0) {
-        Serial.println("Playing track 69 (desk)");
-        player.play(69);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "toilet") == 0) {
-        Serial.println("Playing track 70 (toilet)");
-        player.play(70);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "door") == 0) {
-        Serial.println("Playing track 71 (door)");
-        player.play(71);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "tv") == 0) {
-        Serial.println("Playing track 72 (tv)");
-        player.play(72);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "laptop") == 0) {
-        Serial.println("Playing track 73 (laptop)");
-        player.play(73);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "mouse") == 0) {
-        Serial.println("Playing track 74 (mouse)");
-        player.play(74);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "remote") == 0) {
-        Serial.println("Playing track 75 (remote)");
-        player.play(75);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "keyboard") == 0) {
-        Serial.println("Playing track 76 (keyboard)");
-        player.play(76);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "cell phone") == 0) {
-        Serial.println("Playing track 77 (cell phone)");
-        player.play(77);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "microwave") == 0) {
-        Serial.println("Playing track 78 (microwave)");
-        player.play(78);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "oven") == 0) {
-        Serial.println("Playing track 79 (oven)");
-        player.play(79);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "toaster") == 0) {
-        Serial.println("Playing track 80 (toaster)");
-        player.play(80);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "sink") == 0) {
-        Serial.println("Playing track 81 (sink)");
-        player.play(81);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "refrigerator") == 0) {
-        Serial.println("Playing track 82 (refrigerator)");
-        player.play(82);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "blender") == 0) {
-        Serial.println("Playing track 83 (blender)");
-        player.play(83);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "book") == 0) {
-        Serial.println("Playing track 84 (book)");
-        player.play(84);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "clock") == 0) {
-        Serial.println("Playing track 85 (clock)");
-        player.play(85);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "vase") == 0) {
-        Serial.println("Playing track 86 (vase)");
-        player.play(86);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "scissors") == 0) {
-        Serial.println("Playing track 87 (scissors)");
-        player.play(87);
-        playCommandSent = true;
-    }
-    else if (strcmp(label, "teddy bear") == 0) {
-        Serial.println("Playing track 88 (teddy bear)");
-        player.play(88);
-        playCommandSent = true;
+    if (action.track == 0) {
+        Serial.println("Label not recognized or no action defined.");
+        return;
     }
-    else if (strcmp(label, "hair drier") == 0) {
-        Serial.println("Playing track 89 (hair drier)");
-        player.play(89);
-        playCommandSent = true;
+
+    unsigned long now = millis();
+    int slot = -1, leastUrgent = 0;
+    for (int i = 0; i < audioQueueCount; i++) {
+        if (audioQueue[i].class_id == classId) slot = i;
+        if (audioQueue[i].urgency < audioQueue[leastUrgent].urgency) leastUrgent = i;
     }
-    else if (strcmp(label, "toothbrush") == 0) {
-        Serial.println("Playing track 90 (toothbrush)");
-        player.play(90);
-        playCommandSent = true;
+    if (slot >= 0) {
+        if (urgency < audioQueue[slot].urgency) urgency = audioQueue[slot].urgency;
+    } else if (audioQueueCount < AUDIO_QUEUE_SIZE) {
+        slot = audioQueueCount++;
+    } else if (urgency > audioQueue[leastUrgent].urgency) {
+        slot = leastUrgent;
+    } else {
+        Serial.println("Skipping audio - more urgent alerts are waiting");
+        return;
     }
-    else if (strcmp(label, "hair brush") == 0) {
-        Serial.println("Playing track 91 (hair brush)");
-        player.play(91);
-        playCommandSent = true;
+    audioQueue[slot] = { classId, urgency, now };
+}
+
+void removeQueuedAudio(int index) {
+    audioQueue[index] = audioQueue[--audioQueueCount];
+}
+
+// Whether a class's debounce window lets it play now
+bool audioDebounced(uint8_t classId, uint8_t urgency, unsigned long now) {
+    if (!playedOnce[classId] || urgency >= ALERT_URGENCY_CRITICAL) return false;
+    return now - lastPlayedMs[classId] < CLASS_ACTIONS[classId].debounce_ms;
+}
+
+// Called every loop(): start the most urgent alert that may play. It
+// preempts the playing track if it is more urgent; DFPlayer play() switches
+// tracks in a single command.
+void serviceAudio(unsigned long now) {
+    if (isAudioPlaying && now - playingSince > AUDIO_TRACK_TIMEOUT) {
+        isAudioPlaying = false;
+    }
+
+    int best = -1;
+    for (int i = audioQueueCount - 1; i >= 0; i--) {
+        const PendingAlert& alert = audioQueue[i];
+        if (now - alert.received_ms > AUDIO_ALERT_MAX_AGE ||
+            (isAudioPlaying && alert.class_id == playingClass)) {
+            removeQueuedAudio(i);  // Stale, or already being announced
+            continue;
+        }
+        if (audioDebounced(alert.class_id, alert.urgency, now)) continue;
+        if (best < 0 || alert.urgency > audioQueue[best].urgency ||
+            (alert.urgency == audioQueue[best].urgency && alert.received_ms > audioQueue[best].received_ms)) {
+            best = i;
+        }
     }
-    else {
-        Serial.println("Label not recognized or no action defined.");
+    if (best < 0) return;
+
+    PendingAlert alert = audioQueue[best];
+    if (isAudioPlaying && alert.urgency <= playingUrgency) {
+        return;  // Waits for the current track unless it goes stale first
     }
+    removeQueuedAudio(best);
+
+    if (isAudioPlaying) {
+        Serial.print("Preempting ");
+        Serial.print(CLASS_ACTIONS[playingClass].label);
+        Serial.print(" - ");
+    }
+    Serial.print("Playing track ");
+    Serial.println(CLASS_ACTIONS[alert.class_id].track);
+    player.play(CLASS_ACTIONS[alert.class_id].track);
+
+    isAudioPlaying = true;
+    playingClass = alert.class_id;
+    playingUrgency = alert.urgency;
+    playingSince = now;
+    lastPlayedMs[alert.class_id] = now;
+    playedOnce[alert.class_id] = true;
+}
 
-    // --- Update state ONLY if play command was successfully sent ---
-    if (playCommandSent) {
-        isAudioPlaying = true; // Set the flag indicating playback has started
-        lastAudioPlayTime = currentTime; // Update time debounce timer
-        strncpy(lastPlayedLabel, label, MAX_LABEL_LENGTH); // Update last played label
-        lastPlayedLabel[MAX_LABEL_LENGTH - 1] = '\0'; // Ensure null termination
-        Serial.print("Updated last played label to: ");
-        Serial.println(lastPlayedLabel);
+void showLedPattern(LedPattern pattern) {
+    if (pattern == LED_HAZARD) {
+        uint32_t color = strip1.Color(BRIGHTNESS, 0, 0);
+        startBlink(animation1, color, BLINK_DURATION);
+        startBlink(animation2, color, BLINK_DURATION);
     }
 }
 
-// --- ESP-NOW Callback ---
-void onDataReceive(const esp_now_recv_info_t *info, const uint8_t *incomingData, int len) {
-    if (len == sizeof(message)) {
+// Full handling of one alert: audio plus the class's LED pattern
+void handleAlert(uint8_t classId, uint8_t urgency) {
+    queueAudio(classId, urgency);
+    showLedPattern(CLASS_ACTIONS[classId].led);
+}
+
+// --- Packet Handling ---
+// Packets are handed from the ESP-NOW callback, which runs on the Wi-Fi task,
+// to loop() through a queue, so nothing slow happens while receiving
+#define PACKET_QUEUE_LENGTH 8
+typedef struct received_packet {
+    int len;                               // As received; longer packets are rejected
+    uint8_t data[sizeof(struct_message)];  // The largest packet accepted
+} received_packet;
+
+QueueHandle_t packetQueue;
+
+void handlePacket(const uint8_t *incomingData, int len) {
+    if (len == sizeof(alert_packet) && incomingData[0] == ALERT_PACKET_MAGIC) {
+        alert_packet alert;
+        memcpy(&alert, incomingData, sizeof(alert));
+        if (alert.version != ALERT_PACKET_VERSION || alert.class_id >= NUM_CLASSES) {
+            Serial.print("Ignoring alert packet version ");
+            Serial.print(alert.version);
+            Serial.print(", class ");
+            Serial.println(alert.class_id);
+            return;
+        }
+        if (haveAlertSequence && alert.sequence == lastAlertSequence) {
+            return; // Retransmission of an alert already handled
+        }
+        haveAlertSequence = true;
+        lastAlertSequence = alert.sequence;
+
+        Serial.print("Received alert ");
+        Serial.print(alert.sequence);
+        Serial.print(": class ");
+        Serial.print(alert.class_id);
+        Serial.print(", urgency ");
+        Serial.print(alert.urgency);
+        Serial.print(", ");
+        Serial.print(alert.distance_cm);
+        Serial.println(" cm");
+        handleAlert(alert.class_id, alert.urgency);
+    } else if (len == sizeof(message)) {
         memcpy(&message, incomingData, sizeof(message));
         
         if (message.isLabel) {
@@ -576,7 +432,7 @@ void onDataReceive(const esp_now_recv_info_t *info, const uint8_t *incomingData,
             Serial.print("' (Length: ");
             Serial.print(strlen(message.label)); // Use strlen for C-string
             Serial.println(")");
-            playAudioForLabel(message.label);
+            handleAlert(lookupClassId(message.label), ALERT_URGENCY_LEGACY);
         } else {
             // Handle command-based message (original functionality)
             Serial.print("Received command: ");
@@ -585,20 +441,32 @@ void onDataReceive(const esp_now_recv_info_t *info, const uint8_t *incomingData,
             uint32_t dimmedColor = strip1.Color(BRIGHTNESS, 0, 0);
 
             if (message.command == 1) {
-                blinkLED(strip1, dimmedColor);
+                startBlink(animation1, dimmedColor, BLINK_DURATION);
             }
             if (message.command == 2) {
-                blinkLED(strip2, dimmedColor);
+                startBlink(animation2, dimmedColor, BLINK_DURATION);
             }
         }
     } else {
         Serial.print("Received data of incorrect length: ");
         Serial.print(len);
         Serial.print(", expected: ");
+        Serial.print(sizeof(alert_packet));
+        Serial.print(" or ");
         Serial.println(sizeof(message));
     }
 }
 
+// --- ESP-NOW Callback ---
+void onDataReceive(const esp_now_recv_info_t *info, const uint8_t *incomingData, int len) {
+    received_packet packet;
+    packet.len = len;
+    memcpy(packet.data, incomingData, len < (int)sizeof(packet.data) ? len : sizeof(packet.data));
+    if (xQueueSend(packetQueue, &packet, 0) != pdTRUE) {
+        Serial.println("Packet queue full, dropping packet");
+    }
+}
+
 
 void setup() {
     Serial.begin(115200);
@@ -625,6 +493,11 @@ void setup() {
         Serial.println("Failed to connect to DFPlayer Mini!");
     }
 
+    // Class lookup for legacy label packets, ready before any can arrive
+    initClassTable();
+
+    packetQueue = xQueueCreate(PACKET_QUEUE_LENGTH, sizeof(received_packet));
+
     // ESP-NOW Setup
     if (esp_now_init() != ESP_OK) {
         Serial.println("ESP-NOW Init Failed");
@@ -633,14 +506,23 @@ void setup() {
 
     esp_now_register_recv_cb(onDataReceive);
 
-    // Optional: Initialize lastPlayedLabel explicitly (already done globally, but safe)
-    lastPlayedLabel[0] = '\0'; 
-
     isAudioPlaying = false; // Ensure flag is initially false
 }
 
 
 void loop() {
+    // --- Handle packets received since the last frame ---
+    received_packet packet;
+    while (xQueueReceive(packetQueue, &packet, 0) == pdTRUE) {
+        handlePacket(packet.data, packet.len);
+    }
+
+    // --- Start or preempt audio, then render both strips ---
+    unsigned long now = millis();
+    serviceAudio(now);
+    renderAnimation(animation1, now);
+    renderAnimation(animation2, now);
+
     // --- Check for DFPlayer Messages (like playback finished) ---
     if (player.available()) {
         uint8_t type = player.readType();
@@ -650,8 +532,6 @@ void loop() {
             case DFPlayerPlayFinished: // Track finished playing
                 Serial.println(F("DFPlayer Finished Playing."));
                 isAudioPlaying = false; // Clear the flag
-                // We could potentially clear lastPlayedLabel here too if needed:
-                // lastPlayedLabel[0] = '\0'; 
                 break;
             case DFPlayerError: // Handle errors if needed
                  Serial.print(F("DFPlayer error: "));
@@ -665,6 +545,7 @@ void loop() {
         }
     }
     
-    // Keep a small delay for stability, doesn't need to be large
-    delay(20); 
+    // Sleep until the next frame, waking early when a packet arrives so
+    // alerts are never held up by the frame timer
+    xQueuePeek(packetQueue, &packet, pdMS_TO_TICKS(FRAME_MS));
 }
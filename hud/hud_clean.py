@@ -7,6 +7,7 @@ import pygame
 import threading
 import os
 import json
+import struct
 from collections import defaultdict
 
 # ----------------------------
@@ -33,6 +34,11 @@ ANGLE_BUCKET_SIZE = 5.0
 MAX_ANGLE_DIFF = 10.0
 SMOOTHING_ALPHA = 0.3  # Added smoothing factor for measurements
 
+# Binary LIDAR frames (lidar_zmq_refined --binary-lidar)
+LIDAR_FRAME_MAGIC = b"LBIN"
+LIDAR_FRAME_HEADER = struct.Struct("<4sHHIIQ")
+LIDAR_POINT = struct.Struct("<hH")
+
 # Animation parameters
 ANIMATION_SPEED = 0.4  # Slightly increased for smoother motion at lower FPS
 POSITION_LERP_ALPHA = 0.2  # Slightly increased for faster response
@@ -503,9 +509,19 @@ class LidarHUD:
                 # Process LIDAR data with lower priority
                 if self.lidar_subscriber in socks:
                     try:
-                        msg = self.lidar_subscriber.recv_string(zmq.NOBLOCK)
-                        if msg.startswith("LIDAR_DATA"):
-                            data_str = msg[10:].strip()
+                        raw = self.lidar_subscriber.recv(zmq.NOBLOCK)
+                        if raw.startswith(LIDAR_FRAME_MAGIC):
+                            # Binary frame: fixed header followed by packed (int16 cdeg, uint16 mm)
+                            count = LIDAR_FRAME_HEADER.unpack_from(raw)[2]
+                            self.lidar_points = [
+                                (angle_cdeg / 100.0, float(dist_mm))
+                                for angle_cdeg, dist_mm in LIDAR_POINT.iter_unpack(
+                                    raw[LIDAR_FRAME_HEADER.size:LIDAR_FRAME_HEADER.size + count * LIDAR_POINT.size])
+                            ]
+                            self.update_lidar_map()
+                            self.last_lidar_update = current_time
+                        elif raw.startswith(b"LIDAR_DATA"):
+                            data_str = raw[10:].decode().strip()
                             self.lidar_points = [
                                 (float(p.split(',')[0]), float(p.split(',')[1]))
                                 for p in data_str.split(';')
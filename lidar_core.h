@@ -0,0 +1,1982 @@
+// Scan processing and correlation core of lidar_pipeline.cpp: angle
+// binning, range clustering, detection parsing, tracking and OBJECTS
+// serialization. Header-only and free of ZMQ and serial I/O, so the same
+// code runs in the live pipeline and in bench/lidar_core_bench.cpp.
+#pragma once
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <jsoncpp/json/json.h>
+#include "sl_lidar_driver.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define MAX_ANGLE_DIFF 10.0      // Maximum angle difference for correlation
+#define ANGLE_RESOLUTION 1.0     // Only send points every 1 degree
+#define MIN_DISTANCE_MM 100      // Ignore points closer than 10cm
+#define MAX_DISTANCE_MM 3000     // Ignore points further than 3m (default, see --config)
+#define MAX_OBJECT_AGE_MS 500    // Keep objects for 500ms (default, see --config)
+#define VERBOSE_OUTPUT false      // Control terminal output (default, see --config)
+#define ANGLE_BUCKET_SIZE 5.0    // Size of angle buckets for faster correlation (default, see --config)
+#define MIN_ANGLE_BUCKET_SIZE 1.0  // Smallest configurable bucket; sizes the bin arrays
+#define MAX_DISTANCE_LIMIT_MM 16000  // Largest configurable MAX_DISTANCE_MM (16-bit q2)
+#define FRONT_ARC_DEG 90.0       // Only process points within +/- this angle
+#define OBJECTS_FLOAT_PRECISION 1  // Significant digits for OBJECTS floats (matches the old jsoncpp writer)
+#define DELTA_RANGE_EPSILON_MM 50.0  // Range change that makes an OBJECTS_DELTA update (default, see --config)
+#define DELTA_ANGLE_EPSILON_DEG 1.0  // Angle change that makes an OBJECTS_DELTA update (default, see --config)
+#define MAX_DETECTIONS 64         // Camera detections handled per message
+#define MAX_TRACKED_OBJECTS 32    // Capacity of the correlated object table
+#define MAX_LABEL_LENGTH 32       // Including terminator; matches the ESP32 message label
+#define DETECTION_FRAME_MAGIC "DBIN"  // Magic prefix for binary camera detection messages
+#define DETECTION_FRAME_VERSION 1
+#define TRACK_GATE_DEG 8.0        // Max angle between a track's prediction and a detection
+#define TRACK_GATE_MM 750.0       // Max range between a track's prediction and a detection
+#define TRACK_RANGE_NOISE_MM 100.0   // Range measurement std dev (bucketed LiDAR minimum)
+#define TRACK_ANGLE_NOISE_DEG 2.0    // Camera angle measurement std dev
+#define TRACK_RANGE_ACCEL_MM 3000.0  // Range process noise, mm/s^2
+#define TRACK_ANGLE_ACCEL_DEG 45.0   // Angle process noise, deg/s^2
+#define TRACK_INIT_SPEED_MM 3000.0   // Std dev of a new track's unknown range rate
+#define TRACK_INIT_RATE_DEG 45.0     // Std dev of a new track's unknown angular rate
+#define TRACK_FLOAT_PRECISION 4   // Significant digits for the closing speed and TTC fields
+#define TTC_MIN_CLOSING_MM_S 100.0  // Below this closing speed TTC is reported as -1
+#define CLUSTER_JUMP_MM 150.0     // Range step that always splits a cluster
+#define CLUSTER_JUMP_RATIO 0.08   // Extra allowed range step per mm of range
+#define CLUSTER_MAX_GAP_DEG 2.0   // Angular gap between points that splits a cluster
+#define CLUSTER_MIN_POINTS 3      // Smaller segments are treated as noise
+#define MAX_SCAN_CLUSTERS 64      // Clusters kept per scan
+#define CAPTURE_FILE_MAGIC "SCAP"  // Magic prefix of --capture log files
+#define CAPTURE_FILE_VERSION 1
+#define MAX_SCAN_NODES 8192       // Node buffer size for one grabbed revolution
+#define MAX_SENSORS 4             // Range sensors one process runs
+#define OCCUPANCY_BIN_DEG 1.0     // Angular resolution of the fused all-round occupancy
+#define OCCUPANCY_MAX_SCAN_AGE_MS 300  // Fusion leaves out a sensor whose latest scan is older
+#define OCCUPANCY_RANGE_BIN_MM 200  // Radial resolution of the occupancy evidence
+#define OCCUPANCY_DECAY_MS 250.0  // Time constant of the evidence's exponential decay
+#define OCCUPANCY_HIT 128         // Evidence one return adds to its cell (saturating at 255)
+#define OCCUPANCY_THRESHOLD 64    // Evidence at which a range bin counts as occupied
+#define OCCUPANCY_MATCH_DEG 3.0   // Half-width of the occupancy query that backs up cluster matching
+#define SCAN_PERIOD_MS 100        // Revolution period assumed until one has been measured (10 Hz)
+#define DETECTION_MAX_AGE_MS 500  // Older detection timestamps are treated as clock skew and ignored
+#define RANGE_INTERP_MAX_MS 300   // Cluster sightings further apart than this are not interpolated
+#define IMU_HISTORY 128           // IMU samples kept for deskewing (over a second at 100 Hz)
+#define IMU_MAX_AGE_MS 50         // Without IMU samples during a revolution, one this much older still counts
+#define DESKEW_MIN_TURN_DEG 0.1   // Revolutions turning less than this, and ...
+#define DESKEW_MIN_TRAVEL_MM 10.0 // ... travelling less than this, are left as measured
+#define ALERT_PACKET_MAGIC 0xA5   // First byte of a compact alert packet (alert_packet in esp32_wireless.ino)
+#define ALERT_PACKET_VERSION 1
+#define ALERT_RANGE_MM 3000.0     // Urgency rises from 0 here to 255 at the sensor
+#define ALERT_TTC_HORIZON_S 3.0   // ... and from 0 at this time to collision to 255 at impact
+#define ALERT_MIN_HITS 2          // Tracks need this many detections (and so a speed) to alert
+#define ALERT_MIN_URGENCY 32      // Less urgent objects do not alert at all
+#define ROI_FRAME_MAGIC "ROIH"    // Magic prefix of ROI hint messages for the camera detector
+#define ROI_FRAME_VERSION 1
+#define MAX_ROI_HINTS 16          // Hints per message, most urgent first
+#define ROI_RANGE_MM 6000.0       // Clusters nearer than this are hinted, priority rising to 255 at the sensor
+#define ROI_MARGIN_DEG 2.0        // Hints are widened this much each side for camera/LiDAR misalignment
+#define FLIGHT_RECORDER_EVENTS 16384  // Events kept in memory, a few minutes at normal rates (power of two)
+#define FLIGHT_FILE_MAGIC "FREC"  // Magic prefix of flight recorder dumps
+#define FLIGHT_FILE_VERSION 1
+
+// Pipeline stages timed with steady_clock and reported in the STATS message
+enum PipelineStage {
+    STAGE_GRAB,                // SDK call returning scan data (includes waiting for it)
+    STAGE_BIN,                 // Binning and clustering the returned nodes
+    STAGE_PUBLISH_LIDAR,       // Serializing and sending LIDAR data
+    STAGE_PARSE,               // Parsing one detection message
+    STAGE_CORRELATE,           // Cluster matching and tracking for one message
+    STAGE_PUBLISH_OBJECTS,     // Serializing and sending OBJECTS
+    STAGE_SCAN_AGE,            // Scan hand-off to its use by the correlator
+    STAGE_FUSE,                // Merging every sensor's latest scan into the occupancy
+    NUM_STAGES
+};
+
+const char* const STAGE_NAMES[NUM_STAGES] = {
+    "grab", "bin", "publish_lidar", "parse", "correlate", "publish_objects", "scan_age", "fuse"
+};
+
+// Lock-free latency histogram over nanoseconds: each power of two is split
+// into 4 sub-buckets, so a reported percentile is within 25% of the true
+// value. Writers only do relaxed increments; the reporter diffs snapshots.
+const int HISTOGRAM_SUB_BITS = 2;
+const int HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+const int HISTOGRAM_BUCKETS = 64 * HISTOGRAM_SUB_BUCKETS;
+
+struct LatencyHistogram {
+    std::atomic<uint32_t> counts[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> max_ns;  // Since the last report
+};
+
+inline LatencyHistogram g_stage_histograms[NUM_STAGES];
+
+// Class IDs for detection labels. The IDs are the DFPlayer track numbers used
+// by esp32_wireless.ino (COCO order) and the class_id of its compact alert
+// packets; 0 is any label not in the table. OBJECTS carry the detector's own
+// label either way. Keep CLASS_ACTIONS there and CLASS_LABELS in
+// esp32_bridge.py in the same order.
+const char* const CLASS_LABELS[] = {
+    "unknown",
+    "person", "bicycle", "car", "motorcycle", "airplane", "bus",
+    "train", "truck", "boat", "traffic light", "fire hydrant", "street sign",
+    "stop sign", "parking meter", "bench", "bird", "cat", "dog",
+    "horse", "sheep", "cow", "elephant", "bear", "zebra",
+    "giraffe", "hat", "backpack", "umbrella", "shoe", "eye glasses",
+    "handbag", "tie", "suitcase", "frisbee", "skis", "snowboard",
+    "sports ball", "kite", "baseball bat", "baseball glove", "skateboard", "surfboard",
+    "tennis racket", "bottle", "plate", "wine glass", "cup", "fork",
+    "knife", "spoon", "bowl", "banana", "apple", "sandwich",
+    "orange", "broccoli", "carrot", "hot dog", "pizza", "donut",
+    "cake", "chair", "couch", "potted plant", "bed", "mirror",
+    "dining table", "window", "desk", "toilet", "door", "tv",
+    "laptop", "mouse", "remote", "keyboard", "cell phone", "microwave",
+    "oven", "toaster", "sink", "refrigerator", "blender", "book",
+    "clock", "vase", "scissors", "teddy bear", "hair drier", "toothbrush",
+    "hair brush",
+};
+const int NUM_CLASSES = sizeof(CLASS_LABELS) / sizeof(CLASS_LABELS[0]);
+const uint8_t CLASS_UNKNOWN = 0;
+
+// Open-addressed label -> class ID table, filled once by initClassTable()
+const int CLASS_TABLE_SIZE = 256;
+inline uint8_t g_class_table[CLASS_TABLE_SIZE];
+
+// Constant-velocity Kalman filter for one coordinate: state [pos, vel]
+struct KalmanCV {
+    float pos;
+    float vel;
+    float p00, p01, p11;       // Covariance [[p00, p01], [p01, p11]]
+};
+
+// Structure to hold object data. Each object is a track: detections are
+// associated to it by predicted position, so its id survives movement.
+struct DetectedObject {
+    uint32_t track_id;         // Stable for the life of the track
+    char label[MAX_LABEL_LENGTH];  // As the detector sent it, also for CLASS_UNKNOWN
+    uint8_t class_id;          // Index into CLASS_LABELS
+    float confidence;
+    float angle_deg;           // Filtered angle
+    float distance_mm;         // Filtered range
+    float area;
+    KalmanCV range;            // mm, mm/s
+    KalmanCV angle;            // deg, deg/s
+    uint32_t hits;             // Detections associated so far
+    uint64_t last_update_ms;
+};
+
+// Binary camera detection message (little-endian, packed), an optional
+// alternative to JSON on the detection port
+#pragma pack(push, 1)
+struct DetectionFrameHeader {
+    char magic[4];             // DETECTION_FRAME_MAGIC, no terminator
+    uint16_t version;          // DETECTION_FRAME_VERSION
+    uint16_t count;            // Number of DetectionRecord entries that follow
+    uint32_t frame;            // Camera frame counter
+    uint32_t reserved;
+    uint64_t timestamp_us;     // Capture time, microseconds since the epoch
+};
+
+struct DetectionRecord {
+    float confidence;
+    float angle_deg;
+    float area;
+    char label[16];            // NUL-padded, not terminated when 16 chars long
+};
+#pragma pack(pop)
+
+static_assert(sizeof(DetectionFrameHeader) == 24, "DetectionFrameHeader layout changed");
+static_assert(sizeof(DetectionRecord) == 28, "DetectionRecord layout changed");
+
+// Compact alert packet for the helmet ESP32 (little-endian, packed). The
+// tethered ESP32 forwards it over ESP-NOW unchanged.
+#pragma pack(push, 1)
+struct AlertPacket {
+    uint8_t magic;             // ALERT_PACKET_MAGIC
+    uint8_t version;           // ALERT_PACKET_VERSION
+    uint8_t class_id;          // Index into CLASS_LABELS
+    uint8_t urgency;           // 0 (informational) to 255 (critical)
+    uint16_t distance_cm;      // Range to the object, 0 when unknown
+    uint16_t sequence;         // Incremented per alert; a repeat is a retransmission
+};
+#pragma pack(pop)
+
+static_assert(sizeof(AlertPacket) == 8, "AlertPacket layout changed");
+
+// Region-of-interest hints for the camera detector (little-endian, packed):
+// an RoiFrameHeader, then count RoiHint entries. Angles are in the camera's
+// convention, the one its detections use; columns follow from its FOV.
+#pragma pack(push, 1)
+struct RoiFrameHeader {
+    char magic[4];             // ROI_FRAME_MAGIC, no terminator
+    uint16_t version;          // ROI_FRAME_VERSION
+    uint16_t count;            // Number of RoiHint entries that follow, 0 when nothing is in range
+    uint32_t sequence;         // Incremented per message
+    uint32_t reserved;
+    uint64_t timestamp_us;     // When the scan was completed, microseconds since the epoch
+};
+
+struct RoiHint {
+    float min_angle_deg;       // Including ROI_MARGIN_DEG, clipped to the camera's FOV
+    float max_angle_deg;
+    float range_mm;            // Closest point of the cluster
+    uint16_t column_min;       // Image columns covering the angles, inclusive
+    uint16_t column_max;
+    uint8_t priority;          // 255 at the sensor falling to 0 at ROI_RANGE_MM
+    uint8_t reserved[3];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(RoiFrameHeader) == 24, "RoiFrameHeader layout changed");
+static_assert(sizeof(RoiHint) == 20, "RoiHint layout changed");
+
+// Capture log layout (native endianness): a CaptureFileHeader, then records
+// of a CaptureRecordHeader and its payload padded to 8 bytes, so the whole
+// file can be mmap()ed and every payload read in place
+enum CaptureRecordType : uint16_t {
+    CAPTURE_NODES = 1,         // sl_lidar_response_measurement_node_hq_t[] exactly as the SDK returned them
+    CAPTURE_DETECTION = 2,     // One raw message from the detection port
+};
+
+#pragma pack(push, 1)
+struct CaptureFileHeader {
+    char magic[4];             // CAPTURE_FILE_MAGIC, no terminator
+    uint16_t version;          // CAPTURE_FILE_VERSION
+    uint16_t node_size;        // sizeof(sl_lidar_response_measurement_node_hq_t) of the writer
+    uint64_t reserved;
+};
+
+struct CaptureRecordHeader {
+    uint16_t type;             // CaptureRecordType
+    uint16_t reserved;
+    uint32_t size;             // Payload bytes, excluding padding
+    uint64_t timestamp_ns;     // steady_clock time the data was received
+};
+#pragma pack(pop)
+
+static_assert(sizeof(CaptureFileHeader) == 16, "CaptureFileHeader layout changed");
+static_assert(sizeof(CaptureRecordHeader) == 16, "CaptureRecordHeader layout changed");
+
+// Fields of one camera detection used for correlation
+struct CameraDetection {
+    char label[MAX_LABEL_LENGTH];
+    uint8_t class_id;          // Resolved from label by parseDetections()
+    float confidence;
+    float angle_deg;
+    float area;
+};
+
+// Parsed detections of the current message (correlation thread only)
+inline CameraDetection g_detections[MAX_DETECTIONS];
+inline uint64_t g_detections_timestamp_us = 0;  // Capture time of g_detections, wall clock us; 0 if not sent
+
+// Correlated objects, kept packed at the front of the table
+inline DetectedObject g_objects[MAX_TRACKED_OBJECTS];
+inline int g_object_count = 0;
+inline uint32_t g_next_track_id = 1;
+
+// Runtime tunables, set from the config file and read by any thread
+inline std::atomic<bool> g_verbose{VERBOSE_OUTPUT};
+inline std::atomic<uint32_t> g_max_object_age_ms{MAX_OBJECT_AGE_MS};
+
+// Capacity for the finest configurable bucket layout over -FRONT_ARC_DEG..+FRONT_ARC_DEG
+const int MAX_ANGLE_BUCKETS = 2 * static_cast<int>(FRONT_ARC_DEG / MIN_ANGLE_BUCKET_SIZE) + 1;
+
+// Bucket layout and range limit a scan is binned with, precomputed for the
+// fixed-point node path. Built from the config by makeScanGeometry(); the
+// defaults are the compile-time ones.
+struct ScanGeometry {
+    float bucket_size_deg = ANGLE_BUCKET_SIZE;
+    int half_buckets = static_cast<int>(FRONT_ARC_DEG / ANGLE_BUCKET_SIZE);
+    int num_buckets = 2 * static_cast<int>(FRONT_ARC_DEG / ANGLE_BUCKET_SIZE) + 1;
+    uint16_t bucket_recip_q16 = static_cast<uint16_t>(360.0 / ANGLE_BUCKET_SIZE);  // Buckets per 1 << 16 of q14 angle
+    float max_distance_mm = MAX_DISTANCE_MM;
+    uint16_t max_distance_q2 = MAX_DISTANCE_MM * 4;
+    uint32_t version = 0;      // Bumped for every reload so readers can spot a new layout
+};
+
+static_assert(static_cast<int>(360.0 / ANGLE_BUCKET_SIZE) * ANGLE_BUCKET_SIZE == 360.0, "ANGLE_BUCKET_SIZE must divide 360");
+static_assert(ANGLE_BUCKET_SIZE >= MIN_ANGLE_BUCKET_SIZE, "ANGLE_BUCKET_SIZE below MIN_ANGLE_BUCKET_SIZE");
+static_assert(MAX_DISTANCE_MM <= MAX_DISTANCE_LIMIT_MM, "MAX_DISTANCE_MM above MAX_DISTANCE_LIMIT_MM");
+static_assert(MAX_DISTANCE_LIMIT_MM * 4 < 65536, "Distance limits must fit the 16-bit compare");
+
+// Validate a configured bucket size and range limit and derive the rest.
+// Returns false, leaving out untouched, when the values are unusable.
+inline bool makeScanGeometry(double bucketSizeDeg, double maxDistanceMm, ScanGeometry& out) {
+    if (!(bucketSizeDeg >= MIN_ANGLE_BUCKET_SIZE && bucketSizeDeg <= FRONT_ARC_DEG)) return false;
+    double halfBuckets = FRONT_ARC_DEG / bucketSizeDeg;
+    double recip = 360.0 / bucketSizeDeg;
+    if (fabs(halfBuckets - std::round(halfBuckets)) > 1e-6 || fabs(recip - std::round(recip)) > 1e-6) {
+        return false;  // Buckets must tile the arc and the revolution exactly
+    }
+    if (!(maxDistanceMm > MIN_DISTANCE_MM && maxDistanceMm <= MAX_DISTANCE_LIMIT_MM)) return false;
+
+    out.bucket_size_deg = static_cast<float>(bucketSizeDeg);
+    out.half_buckets = static_cast<int>(std::lround(halfBuckets));
+    out.num_buckets = 2 * out.half_buckets + 1;
+    out.bucket_recip_q16 = static_cast<uint16_t>(std::lround(recip));
+    out.max_distance_q2 = static_cast<uint16_t>(std::lround(maxDistanceMm * 4));
+    out.max_distance_mm = out.max_distance_q2 / 4.0f;
+    return true;
+}
+
+// Binning state of one sensor, owned by its acquisition thread
+struct ScanContext {
+    ScanGeometry geometry;     // Layout new scans are binned with; reloads are adopted between scans
+    uint32_t generation = 0;   // Generation of the last scan started
+    uint16_t codes[MAX_SCAN_NODES];  // classifyNodes() output for binScan()
+};
+
+// Closest distance seen in one angle bucket. A bin only holds data for its
+// scan when its generation matches the scan's generation, so starting a new
+// scan is a single increment instead of clearing the array.
+struct AngleBin {
+    float distance_mm;
+    uint32_t generation;
+    uint64_t capture_ns;       // steady_clock time the closest point was measured
+};
+
+// One contiguous object in the front arc, split from its neighbours by a
+// range discontinuity or an angular gap
+struct ScanCluster {
+    float min_angle_deg;
+    float max_angle_deg;
+    float centroid_mm;         // Mean range of the cluster's points
+    float min_mm;              // Closest point
+    int point_count;
+    uint64_t capture_ns;       // steady_clock time the closest point was measured
+};
+
+// Angle-indexed bins for one completed scan, read by the publisher, plus the
+// scan's clusters in ascending angle order, read by the correlator. The
+// first geometry.num_buckets bins are in use.
+struct ScanBins {
+    ScanGeometry geometry;
+    AngleBin bins[MAX_ANGLE_BUCKETS] = {};
+    uint32_t generation = 0;   // 0 until the first scan has been written
+    int valid_count = 0;       // Bins filled during this scan
+    uint64_t completed_ns = 0; // steady_clock time the scan was handed off
+    ScanCluster clusters[MAX_SCAN_CLUSTERS];
+    int cluster_count = 0;
+};
+
+// Cluster being grown while front-arc points are fed in sweep order
+struct ClusterBuilder {
+    bool open = false;
+    float first_angle = 0.0f;
+    float last_angle = 0.0f;
+    float last_mm = 0.0f;
+    float sum_mm = 0.0f;
+    float min_mm = 0.0f;
+    uint64_t min_ns = 0;
+    int points = 0;
+};
+
+// When a grabbed revolution was measured: it ended at end_ns, took
+// period_ns, and its first node was at start_angle_q14. The LiDAR sweeps
+// at a steady rate, so a node's capture time follows from its angle.
+struct ScanTiming {
+    uint64_t end_ns;
+    uint64_t period_ns;
+    uint16_t start_angle_q14;
+};
+
+// Lock-free single-producer / single-consumer triple buffer. The writer fills
+// back() and publish()es it; the reader always gets the most recently
+// published value from read() without ever blocking the writer.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer side: slot to fill before the next publish()
+    T& back() { return buffers[back_index]; }
+
+    // Writer side: make back() the latest value and take a free slot
+    void publish() {
+        int previous = middle.exchange(back_index | FRESH_BIT, std::memory_order_acq_rel);
+        back_index = previous & INDEX_MASK;
+    }
+
+    // Reader side: latest published value, valid until the next read()
+    const T& read() {
+        if (middle.load(std::memory_order_relaxed) & FRESH_BIT) {
+            int previous = middle.exchange(front_index, std::memory_order_acq_rel);
+            front_index = previous & INDEX_MASK;
+        }
+        return buffers[front_index];
+    }
+
+private:
+    static const int INDEX_MASK = 0x3;
+    static const int FRESH_BIT = 0x4;
+
+    T buffers[3];
+    int back_index = 0;              // Owned by the writer
+    int front_index = 1;             // Owned by the reader
+    std::atomic<int> middle{2};      // Shared slot index plus FRESH_BIT
+};
+
+inline float convertRawAngleToDegrees(float raw_angle) {
+    float angle = -raw_angle;
+    while (angle <= -180.0f) angle += 360.0f;
+    while (angle > 180.0f) angle -= 360.0f;
+    return angle;
+}
+
+inline float roundToNearest(float value, float roundTo) {
+    return roundTo * round(value / roundTo);
+}
+
+// Quantize angle to nearest bucket
+inline float quantizeAngle(const ScanGeometry& geometry, float angle) {
+    return roundToNearest(angle, geometry.bucket_size_deg);
+}
+
+// Map an angle to its bucket index, or -1 if it falls outside the front arc
+inline int angleToBucketIndex(const ScanGeometry& geometry, float angle) {
+    int index = static_cast<int>(lroundf(angle / geometry.bucket_size_deg)) + geometry.half_buckets;
+    return (index >= 0 && index < geometry.num_buckets) ? index : -1;
+}
+
+// Center angle of a bucket index
+inline float bucketIndexToAngle(const ScanGeometry& geometry, int index) {
+    return (index - geometry.half_buckets) * geometry.bucket_size_deg;
+}
+
+inline bool isBinValid(const ScanBins& scan, int index) {
+    return scan.bins[index].generation == scan.generation;
+}
+
+// Invalidate all bins of a scan slot before filling it
+inline void beginScanBins(ScanContext& context, ScanBins& scan) {
+    context.generation++;
+    if (context.generation == 0) {
+        // Generation wrapped: make sure no stale bin can match again
+        for (AngleBin& bin : scan.bins) bin.generation = 0;
+        context.generation = 1;
+    }
+    scan.generation = context.generation;
+    scan.geometry = context.geometry;
+    scan.valid_count = 0;
+}
+
+// Keep the closest distance for a bucket, and when it was measured
+inline void updateBin(ScanBins& scan, int index, float distance, uint64_t capture_ns) {
+    AngleBin& bin = scan.bins[index];
+    if (bin.generation != scan.generation) {
+        bin.generation = scan.generation;
+        bin.distance_mm = distance;
+        bin.capture_ns = capture_ns;
+        scan.valid_count++;
+    } else if (distance < bin.distance_mm) {
+        bin.distance_mm = distance;
+        bin.capture_ns = capture_ns;
+    }
+}
+
+// Estimated capture time of a node in a grabbed revolution
+inline uint64_t nodeCaptureTime(const ScanTiming& timing, uint16_t angle_z_q14) {
+    uint16_t swept = static_cast<uint16_t>(angle_z_q14 - timing.start_angle_q14);
+    return timing.end_ns - timing.period_ns + ((timing.period_ns * swept) >> 16);
+}
+
+// Finish the open cluster, keeping it if it has enough points
+inline void closeCluster(ClusterBuilder& b, ScanCluster* clusters, int& count) {
+    if (b.open && b.points >= CLUSTER_MIN_POINTS && count < MAX_SCAN_CLUSTERS) {
+        ScanCluster& c = clusters[count++];
+        c.min_angle_deg = std::min(b.first_angle, b.last_angle);
+        c.max_angle_deg = std::max(b.first_angle, b.last_angle);
+        c.centroid_mm = b.sum_mm / b.points;
+        c.min_mm = b.min_mm;
+        c.point_count = b.points;
+        c.capture_ns = b.min_ns;
+    }
+    b.open = false;
+}
+
+// Feed one in-range front-arc point in sweep order. Points are segmented
+// where the range jumps by more than the range-scaled threshold or the angle
+// skips; callers close the cluster on out-of-range points (wall behind, or
+// too close) and skip nodes without a return.
+inline void segmentPoint(ClusterBuilder& b, float angle, float distance, uint64_t capture_ns,
+                         ScanCluster* clusters, int& count) {
+    if (b.open) {
+        float limit = CLUSTER_JUMP_MM + CLUSTER_JUMP_RATIO * std::min(distance, b.last_mm);
+        if (fabsf(distance - b.last_mm) > limit || fabsf(angle - b.last_angle) > CLUSTER_MAX_GAP_DEG) {
+            closeCluster(b, clusters, count);
+        }
+    }
+
+    if (!b.open) {
+        b.open = true;
+        b.first_angle = angle;
+        b.sum_mm = 0.0f;
+        b.min_mm = distance;
+        b.min_ns = capture_ns;
+        b.points = 0;
+    }
+    b.last_angle = angle;
+    b.last_mm = distance;
+    b.sum_mm += distance;
+    if (distance < b.min_mm) {
+        b.min_mm = distance;
+        b.min_ns = capture_ns;
+    }
+    b.points++;
+}
+
+// Get current time in microseconds
+inline uint64_t getCurrentTimeUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+}
+
+// Get current time in milliseconds
+inline uint64_t getCurrentTimeMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+}
+
+// Get monotonic time in nanoseconds (not affected by wall clock changes)
+inline uint64_t getMonotonicTimeNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+// Monotonic time in milliseconds, for internal timers and ages
+inline uint64_t getMonotonicTimeMs() {
+    return getMonotonicTimeNs() / 1000000;
+}
+
+// Histogram bucket for a duration: values below 4ns get their own bucket,
+// then 4 per power of two
+inline int histogramBucket(uint64_t ns) {
+    if (ns < static_cast<uint64_t>(HISTOGRAM_SUB_BUCKETS)) return static_cast<int>(ns);
+    int msb = 63 - __builtin_clzll(ns);
+    int sub = static_cast<int>(ns >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// Midpoint of a histogram bucket in nanoseconds
+inline uint64_t histogramBucketValue(int bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) return bucket;
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t lower = static_cast<uint64_t>(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+    return lower + (1ULL << shift) / 2;
+}
+
+// Record one stage duration; safe from any thread
+inline void recordLatency(PipelineStage stage, uint64_t ns) {
+    LatencyHistogram& h = g_stage_histograms[stage];
+    h.counts[histogramBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t prev = h.max_ns.load(std::memory_order_relaxed);
+    while (ns > prev && !h.max_ns.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+}
+
+// Record the time elapsed since start_ns
+inline void recordStage(PipelineStage stage, uint64_t start_ns) {
+    recordLatency(stage, getMonotonicTimeNs() - start_ns);
+}
+
+// Flight recorder: the last FLIGHT_RECORDER_EVENTS pipeline events, always
+// on, so the exact timing around a missed alert can be dumped afterwards.
+// Any thread records with one fetch_add and a few relaxed stores.
+enum FlightEventType : uint16_t {
+    EVENT_SCAN_GRABBED = 1,    // source: sensor, value: nodes (streaming: per fetch)
+    EVENT_GRAB_FAILED = 2,     // source: sensor, value: sl_result
+    EVENT_DETECTIONS = 3,      // value: detections in the message, 0xFFFFFFFF when it did not parse
+    EVENT_OBJECT_CREATED = 4,  // source: class_id, value: track_id
+    EVENT_OBJECT_EXPIRED = 5,  // source: class_id, value: track_id (including a full table's eviction)
+    EVENT_PUBLISH_LIDAR = 6,   // source: sensor, MAX_SENSORS for the fused view; value: scan sequence
+    EVENT_PUBLISH_OBJECTS = 7, // value: objects in the message
+    EVENT_ALERT_SENT = 8,      // source: class_id, value: urgency << 16 | packet sequence
+    EVENT_ALERT_DROPPED = 9,   // As EVENT_ALERT_SENT, for a packet the serial port did not take
+};
+
+// One dumped event (native endianness, packed)
+#pragma pack(push, 1)
+struct FlightEvent {
+    uint64_t timestamp_ns;     // steady_clock time
+    uint32_t value;
+    uint16_t type;             // FlightEventType
+    uint16_t source;
+};
+
+// Dump file layout: this header, then count FlightEvents oldest first, e.g.
+// numpy.fromfile(path, dtype=[('timestamp_ns', '<u8'), ('value', '<u4'), ('type', '<u2'), ('source', '<u2')], offset=32)
+struct FlightFileHeader {
+    char magic[4];             // FLIGHT_FILE_MAGIC, no terminator
+    uint16_t version;          // FLIGHT_FILE_VERSION
+    uint16_t event_size;       // sizeof(FlightEvent)
+    uint32_t count;
+    uint32_t lost;             // Events overwritten since startup
+    uint64_t dumped_ns;        // steady_clock time of the dump ...
+    uint64_t dumped_us;        // ... and the same moment in microseconds since the epoch
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FlightEvent) == 16, "FlightEvent layout changed");
+static_assert(sizeof(FlightFileHeader) == 32, "FlightFileHeader layout changed");
+static_assert((FLIGHT_RECORDER_EVENTS & (FLIGHT_RECORDER_EVENTS - 1)) == 0, "FLIGHT_RECORDER_EVENTS must be a power of two");
+
+struct FlightRecorder {
+    struct Slot {
+        std::atomic<uint64_t> sequence;  // Event number + 1, 0 while being written
+        std::atomic<uint64_t> timestamp_ns;
+        std::atomic<uint32_t> value;
+        std::atomic<uint16_t> type;
+        std::atomic<uint16_t> source;
+    };
+    Slot slots[FLIGHT_RECORDER_EVENTS];
+    std::atomic<uint64_t> count{0};
+};
+
+inline FlightRecorder g_flight_recorder;
+
+inline void recordEvent(FlightEventType type, uint16_t source, uint32_t value) {
+    uint64_t n = g_flight_recorder.count.fetch_add(1, std::memory_order_relaxed);
+    FlightRecorder::Slot& slot = g_flight_recorder.slots[n & (FLIGHT_RECORDER_EVENTS - 1)];
+    slot.sequence.store(0, std::memory_order_relaxed);  // Readers skip the slot while it changes
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.timestamp_ns.store(getMonotonicTimeNs(), std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.type.store(type, std::memory_order_relaxed);
+    slot.source.store(source, std::memory_order_relaxed);
+    slot.sequence.store(n + 1, std::memory_order_release);
+}
+
+// Event number n, if it is still in the ring and not being rewritten.
+// Only touches lock-free atomics, so it is safe in a signal handler.
+inline bool readFlightEvent(uint64_t n, FlightEvent& out) {
+    const FlightRecorder::Slot& slot = g_flight_recorder.slots[n & (FLIGHT_RECORDER_EVENTS - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != n + 1) return false;
+    out.timestamp_ns = slot.timestamp_ns.load(std::memory_order_relaxed);
+    out.value = slot.value.load(std::memory_order_relaxed);
+    out.type = slot.type.load(std::memory_order_relaxed);
+    out.source = slot.source.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == n + 1;
+}
+
+// FNV-1a hash used for the class table
+inline uint32_t hashLabel(const char* label) {
+    uint32_t hash = 2166136261u;
+    for (const char* c = label; *c; c++) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+    }
+    return hash;
+}
+
+// Build the label -> class ID table
+inline void initClassTable() {
+    memset(g_class_table, CLASS_UNKNOWN, sizeof(g_class_table));
+    for (int id = 1; id < NUM_CLASSES; id++) {
+        uint32_t slot = hashLabel(CLASS_LABELS[id]) % CLASS_TABLE_SIZE;
+        while (g_class_table[slot] != CLASS_UNKNOWN) slot = (slot + 1) % CLASS_TABLE_SIZE;
+        g_class_table[slot] = static_cast<uint8_t>(id);
+    }
+}
+
+// Class ID for a detection label, CLASS_UNKNOWN if it is not a known class
+inline uint8_t lookupClassId(const char* label) {
+    uint32_t slot = hashLabel(label) % CLASS_TABLE_SIZE;
+    while (g_class_table[slot] != CLASS_UNKNOWN) {
+        if (strcmp(CLASS_LABELS[g_class_table[slot]], label) == 0) return g_class_table[slot];
+        slot = (slot + 1) % CLASS_TABLE_SIZE;
+    }
+    return CLASS_UNKNOWN;
+}
+
+inline void kalmanInit(KalmanCV& k, float pos, float posStd, float velStd) {
+    k.pos = pos;
+    k.vel = 0.0f;
+    k.p00 = posStd * posStd;
+    k.p01 = 0.0f;
+    k.p11 = velStd * velStd;
+}
+
+// Advance the state by dt seconds under white-noise acceleration
+inline void kalmanPredict(KalmanCV& k, float dt, float accelStd) {
+    float q = accelStd * accelStd;
+    float dt2 = dt * dt;
+    k.pos += k.vel * dt;
+    k.p00 += 2.0f * dt * k.p01 + dt2 * k.p11 + q * dt2 * dt2 * 0.25f;
+    k.p01 += dt * k.p11 + q * dt2 * dt * 0.5f;
+    k.p11 += q * dt2;
+}
+
+// Fold in a position measurement
+inline void kalmanUpdate(KalmanCV& k, float z, float measStd) {
+    float s = k.p00 + measStd * measStd;
+    float k0 = k.p00 / s;
+    float k1 = k.p01 / s;
+    float y = z - k.pos;
+    k.pos += k0 * y;
+    k.vel += k1 * y;
+    k.p11 -= k1 * k.p01;
+    k.p01 -= k0 * k.p01;
+    k.p00 -= k0 * k.p00;
+}
+
+// Closing speed along the line of sight, positive when the object approaches
+inline float closingSpeed(const DetectedObject& obj) {
+    return -obj.range.vel;
+}
+
+// Seconds until the object reaches the sensor at its current closing speed,
+// or -1 when it is not closing
+inline float timeToCollision(const DetectedObject& obj) {
+    float closing = closingSpeed(obj);
+    if (closing < TTC_MIN_CLOSING_MM_S) return -1.0f;
+    return obj.distance_mm / closing;
+}
+
+// One correlated camera detection waiting for association
+struct TrackMeasurement {
+    int detection;             // Index into g_detections
+    float angle_deg;
+    float distance_mm;
+};
+
+// A gated detection/track pairing, lower cost is closer
+struct TrackCandidate {
+    float cost;
+    int measurement;
+    int track;
+};
+
+inline TrackMeasurement g_measurements[MAX_DETECTIONS];
+inline TrackCandidate g_candidates[MAX_DETECTIONS * MAX_TRACKED_OBJECTS];
+
+// Start a track for an unassociated measurement. When the table is full the
+// least recently updated track is replaced.
+inline void createTrack(const TrackMeasurement& m, uint64_t now_ms) {
+    int index = g_object_count;
+    if (g_object_count < MAX_TRACKED_OBJECTS) {
+        g_object_count++;
+    } else {
+        index = 0;
+        for (int i = 1; i < g_object_count; i++) {
+            if (g_objects[i].last_update_ms < g_objects[index].last_update_ms) index = i;
+        }
+        recordEvent(EVENT_OBJECT_EXPIRED, g_objects[index].class_id, g_objects[index].track_id);
+    }
+
+    const CameraDetection& det = g_detections[m.detection];
+    DetectedObject& obj = g_objects[index];
+    obj.track_id = g_next_track_id++;
+    memcpy(obj.label, det.label, sizeof(obj.label));
+    obj.class_id = det.class_id;
+    obj.confidence = det.confidence;
+    obj.area = det.area;
+    obj.angle_deg = m.angle_deg;
+    obj.distance_mm = m.distance_mm;
+    kalmanInit(obj.range, m.distance_mm, TRACK_RANGE_NOISE_MM, TRACK_INIT_SPEED_MM);
+    kalmanInit(obj.angle, m.angle_deg, TRACK_ANGLE_NOISE_DEG, TRACK_INIT_RATE_DEG);
+    obj.hits = 1;
+    obj.last_update_ms = now_ms;
+    recordEvent(EVENT_OBJECT_CREATED, obj.class_id, obj.track_id);
+}
+
+// Seconds from a track's last update to a measurement. Camera frames can
+// arrive out of order, so an older measurement is applied without a predict.
+inline float trackTimeStep(const DetectedObject& obj, uint64_t now_ms) {
+    return now_ms > obj.last_update_ms ? (now_ms - obj.last_update_ms) * 0.001f : 0.0f;
+}
+
+// Associate measurements with existing tracks of the same class (the same
+// label for ones outside CLASS_LABELS) by gated nearest neighbour on the
+// predicted position, closest pairs first, then update the matched filters
+// and start tracks for the rest. now_ms is the measurements' capture time on
+// the steady clock.
+inline void updateTracks(int measurementCount, uint64_t now_ms) {
+    int trackCount = g_object_count;
+    int candidateCount = 0;
+
+    for (int t = 0; t < trackCount; t++) {
+        const DetectedObject& obj = g_objects[t];
+        float dt = trackTimeStep(obj, now_ms);
+        float predRange = obj.range.pos + obj.range.vel * dt;
+        float predAngle = obj.angle.pos + obj.angle.vel * dt;
+
+        for (int m = 0; m < measurementCount; m++) {
+            const TrackMeasurement& meas = g_measurements[m];
+            const CameraDetection& det = g_detections[meas.detection];
+            if (det.class_id != obj.class_id) continue;
+            if (obj.class_id == CLASS_UNKNOWN && strcmp(det.label, obj.label) != 0) continue;
+
+            float dAngle = (meas.angle_deg - predAngle) / TRACK_GATE_DEG;
+            float dRange = (meas.distance_mm - predRange) / TRACK_GATE_MM;
+            float cost = dAngle * dAngle + dRange * dRange;
+            if (cost > 1.0f) continue;
+
+            g_candidates[candidateCount++] = {cost, m, t};
+        }
+    }
+
+    std::sort(g_candidates, g_candidates + candidateCount,
+              [](const TrackCandidate& a, const TrackCandidate& b) { return a.cost < b.cost; });
+
+    bool measurementUsed[MAX_DETECTIONS] = {};
+    bool trackUsed[MAX_TRACKED_OBJECTS] = {};
+
+    for (int c = 0; c < candidateCount; c++) {
+        const TrackCandidate& cand = g_candidates[c];
+        if (measurementUsed[cand.measurement] || trackUsed[cand.track]) continue;
+        measurementUsed[cand.measurement] = true;
+        trackUsed[cand.track] = true;
+
+        const TrackMeasurement& meas = g_measurements[cand.measurement];
+        const CameraDetection& det = g_detections[meas.detection];
+        DetectedObject& obj = g_objects[cand.track];
+        float dt = trackTimeStep(obj, now_ms);
+
+        kalmanPredict(obj.range, dt, TRACK_RANGE_ACCEL_MM);
+        kalmanUpdate(obj.range, meas.distance_mm, TRACK_RANGE_NOISE_MM);
+        kalmanPredict(obj.angle, dt, TRACK_ANGLE_ACCEL_DEG);
+        kalmanUpdate(obj.angle, meas.angle_deg, TRACK_ANGLE_NOISE_DEG);
+
+        obj.confidence = det.confidence;
+        obj.area = det.area;
+        obj.angle_deg = obj.angle.pos;
+        obj.distance_mm = obj.range.pos;
+        obj.hits++;
+        obj.last_update_ms = std::max(obj.last_update_ms, now_ms);
+    }
+
+    for (int m = 0; m < measurementCount; m++) {
+        if (!measurementUsed[m]) createTrack(g_measurements[m], now_ms);
+    }
+}
+
+// Clean old objects from the table
+inline void cleanOldObjects() {
+    uint64_t current_time = getMonotonicTimeMs();
+    int i = 0;
+    while (i < g_object_count) {
+        if (current_time - g_objects[i].last_update_ms > g_max_object_age_ms.load(std::memory_order_relaxed)) {
+            // Swap-remove keeps the table packed
+            recordEvent(EVENT_OBJECT_EXPIRED, g_objects[i].class_id, g_objects[i].track_id);
+            g_objects[i] = g_objects[--g_object_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+// Alert urgency of a track, 0..255: the larger of how close it is and how
+// soon it arrives at its current closing speed
+inline uint8_t alertUrgency(const DetectedObject& obj) {
+    float score = 1.0f - obj.distance_mm / static_cast<float>(ALERT_RANGE_MM);
+    float ttc = timeToCollision(obj);
+    if (ttc >= 0.0f) {
+        score = std::max(score, 1.0f - ttc / static_cast<float>(ALERT_TTC_HORIZON_S));
+    }
+    return static_cast<uint8_t>(std::clamp(score, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Index into g_objects of the track most worth alerting about, or -1 when
+// none is confirmed, classified and at least ALERT_MIN_URGENCY urgent.
+// Ties go to the nearer object.
+inline int selectAlertObject(uint8_t* urgency_out) {
+    int best = -1;
+    uint8_t best_urgency = 0;
+    for (int i = 0; i < g_object_count; i++) {
+        const DetectedObject& obj = g_objects[i];
+        if (obj.hits < ALERT_MIN_HITS || obj.class_id == CLASS_UNKNOWN) continue;
+        uint8_t urgency = alertUrgency(obj);
+        if (urgency < ALERT_MIN_URGENCY) continue;
+        if (best < 0 || urgency > best_urgency ||
+            (urgency == best_urgency && obj.distance_mm < g_objects[best].distance_mm)) {
+            best = i;
+            best_urgency = urgency;
+        }
+    }
+    *urgency_out = best_urgency;
+    return best;
+}
+
+// Fill in an alert packet for obj
+inline AlertPacket makeAlertPacket(const DetectedObject& obj, uint8_t urgency, uint16_t sequence) {
+    AlertPacket packet;
+    packet.magic = ALERT_PACKET_MAGIC;
+    packet.version = ALERT_PACKET_VERSION;
+    packet.class_id = obj.class_id;
+    packet.urgency = urgency;
+    packet.distance_cm = static_cast<uint16_t>(std::clamp(obj.distance_mm / 10.0f, 0.0f, 65535.0f));
+    packet.sequence = sequence;
+    return packet;
+}
+
+// Append a JSON string literal, escaped the same way as jsoncpp
+inline void appendJsonString(std::string& out, const std::string& value) {
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += "\\u00";
+                    out += HEX[(c >> 4) & 0xF];
+                    out += HEX[c & 0xF];
+                } else {
+                    // Labels are ASCII class names; other bytes are passed through
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+// Append a float the way jsoncpp writes doubles, at OBJECTS_FLOAT_PRECISION by default
+inline void appendJsonFloat(std::string& out, float value, int precision = OBJECTS_FLOAT_PRECISION) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.*g", precision, static_cast<double>(value));
+    out.append(buf, len);
+    // Keep the value recognisable as a real number
+    if (!memchr(buf, '.', len) && !memchr(buf, 'e', len)) {
+        out += ".0";
+    }
+}
+
+inline void appendJsonUInt64(std::string& out, uint64_t value) {
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(value));
+    out.append(buf, len);
+}
+
+// Per-message fields shared by OBJECTS and OBJECTS_DELTA messages
+struct ObjectsMessageInfo {
+    uint64_t timestamp;        // Wall clock send time, ms
+    uint64_t monotonic_ms;     // steady_clock at the same moment, to date each object
+    uint32_t sequence;         // Incremented per message so delta consumers can spot a gap
+    bool forced;
+    bool degraded;             // LiDAR being recovered, distances stale
+};
+
+// Last published position of an object: the baseline deltas are relative to
+struct PublishedObject {
+    uint32_t track_id;
+    float angle_deg;
+    float distance_mm;
+};
+
+inline PublishedObject g_published[MAX_TRACKED_OBJECTS];
+inline int g_published_count = 0;
+
+// One object entry, keys sorted. The object's timestamp is when it was last
+// measured, on the wall clock.
+inline void appendObjectJson(std::string& out, const DetectedObject& obj, const ObjectsMessageInfo& info) {
+    out += "{\"angle_deg\":";
+    appendJsonFloat(out, obj.angle_deg);
+    out += ",\"area\":";
+    appendJsonFloat(out, obj.area);
+    out += ",\"class_id\":";
+    appendJsonUInt64(out, obj.class_id);
+    out += ",\"closing_speed_mm_s\":";
+    appendJsonFloat(out, closingSpeed(obj), TRACK_FLOAT_PRECISION);
+    out += ",\"confidence\":";
+    appendJsonFloat(out, obj.confidence);
+    out += ",\"distance_mm\":";
+    appendJsonFloat(out, obj.distance_mm);
+    out += ",\"label\":";
+    appendJsonString(out, obj.label);
+    uint64_t age_ms = info.monotonic_ms > obj.last_update_ms ? info.monotonic_ms - obj.last_update_ms : 0;
+    out += ",\"timestamp\":";
+    appendJsonUInt64(out, info.timestamp - age_ms);
+    out += ",\"track_id\":";
+    appendJsonUInt64(out, obj.track_id);
+    out += ",\"ttc_s\":";
+    appendJsonFloat(out, timeToCollision(obj), TRACK_FLOAT_PRECISION);
+    out += '}';
+}
+
+// Serialize an OBJECTS message. Keys are written in sorted order and formatted
+// exactly like the jsoncpp StreamWriter used to, so existing parsers see the same
+// bytes apart from the added fields. sensor_status is "degraded" while the
+// LiDAR is being recovered and distances are stale. The message also becomes
+// the baseline for following OBJECTS_DELTA messages.
+inline void writeObjectsMessage(std::string& out, const ObjectsMessageInfo& info) {
+    out.clear();
+    out += "{\"forced\":";
+    out += info.forced ? "true" : "false";
+    out += ",\"objects\":[";
+
+    g_published_count = 0;
+    for (int i = 0; i < g_object_count; i++) {
+        const DetectedObject& obj = g_objects[i];
+        if (i > 0) out += ',';
+        appendObjectJson(out, obj, info);
+        g_published[g_published_count++] = {obj.track_id, obj.angle_deg, obj.distance_mm};
+    }
+
+    out += "],\"sensor_status\":";
+    out += info.degraded ? "\"degraded\"" : "\"ok\"";
+    out += ",\"sequence\":";
+    appendJsonUInt64(out, info.sequence);
+    out += ",\"timestamp\":";
+    appendJsonUInt64(out, info.timestamp);
+    out += ",\"type\":\"OBJECTS\"}";
+}
+
+// Serialize the changes since the last published message as OBJECTS_DELTA:
+// new tracks under "added", tracks that moved at least rangeEpsilonMm or
+// angleEpsilonDeg under "updated" (full entries, as in OBJECTS), and the
+// track_ids of dropped tracks under "removed". Advances the baseline and
+// returns the number of changes; with none, out need not be sent.
+inline int writeObjectsDelta(std::string& out, const ObjectsMessageInfo& info,
+                             float rangeEpsilonMm, float angleEpsilonDeg) {
+    static const DetectedObject* added[MAX_TRACKED_OBJECTS];
+    static const DetectedObject* updated[MAX_TRACKED_OBJECTS];
+    int addedCount = 0;
+    int updatedCount = 0;
+    bool seen[MAX_TRACKED_OBJECTS] = {};
+
+    for (int i = 0; i < g_object_count; i++) {
+        const DetectedObject& obj = g_objects[i];
+        int p = 0;
+        while (p < g_published_count && g_published[p].track_id != obj.track_id) p++;
+        if (p == g_published_count) {
+            added[addedCount++] = &obj;
+            continue;
+        }
+
+        seen[p] = true;
+        PublishedObject& last = g_published[p];
+        if (fabsf(obj.distance_mm - last.distance_mm) >= rangeEpsilonMm ||
+            fabsf(obj.angle_deg - last.angle_deg) >= angleEpsilonDeg) {
+            updated[updatedCount++] = &obj;
+            last.angle_deg = obj.angle_deg;
+            last.distance_mm = obj.distance_mm;
+        }
+    }
+
+    out.clear();
+    out += "{\"added\":[";
+    for (int i = 0; i < addedCount; i++) {
+        if (i > 0) out += ',';
+        appendObjectJson(out, *added[i], info);
+    }
+
+    // Unseen tracks leave the baseline, then the new ones join it
+    out += "],\"removed\":[";
+    int removedCount = 0;
+    int kept = 0;
+    for (int p = 0; p < g_published_count; p++) {
+        if (seen[p]) {
+            g_published[kept++] = g_published[p];
+        } else {
+            if (removedCount++ > 0) out += ',';
+            appendJsonUInt64(out, g_published[p].track_id);
+        }
+    }
+    g_published_count = kept;
+    for (int i = 0; i < addedCount; i++) {
+        g_published[g_published_count++] = {added[i]->track_id, added[i]->angle_deg, added[i]->distance_mm};
+    }
+
+    out += "],\"sensor_status\":";
+    out += info.degraded ? "\"degraded\"" : "\"ok\"";
+    out += ",\"sequence\":";
+    appendJsonUInt64(out, info.sequence);
+    out += ",\"timestamp\":";
+    appendJsonUInt64(out, info.timestamp);
+    out += ",\"type\":\"OBJECTS_DELTA\",\"updated\":[";
+    for (int i = 0; i < updatedCount; i++) {
+        if (i > 0) out += ',';
+        appendObjectJson(out, *updated[i], info);
+    }
+    out += "]}";
+    return addedCount + updatedCount + removedCount;
+}
+
+// Find the cluster a camera detection belongs to. Clusters are disjoint and
+// sorted, so this is a binary search plus a few neighbours. A cluster that
+// contains the camera angle wins; otherwise the angularly nearest one within
+// MAX_ANGLE_DIFF, the closer range breaking ties.
+inline const ScanCluster* matchCluster(const ScanBins& scan, float angle) {
+    const ScanCluster* begin = scan.clusters;
+    const ScanCluster* end = scan.clusters + scan.cluster_count;
+    const ScanCluster* it = std::lower_bound(begin, end, angle - MAX_ANGLE_DIFF,
+        [](const ScanCluster& c, float a) { return c.max_angle_deg < a; });
+
+    const ScanCluster* best = nullptr;
+    float bestGap = 0.0f;
+    for (; it != end && it->min_angle_deg <= angle + MAX_ANGLE_DIFF; ++it) {
+        float gap = 0.0f;
+        if (angle < it->min_angle_deg) gap = it->min_angle_deg - angle;
+        else if (angle > it->max_angle_deg) gap = angle - it->max_angle_deg;
+
+        if (!best || gap < bestGap || (gap == bestGap && it->min_mm < best->min_mm)) {
+            best = &*it;
+            bestGap = gap;
+        }
+    }
+    return best;
+}
+
+// Image column of a camera angle, the inverse of the detector's
+// compute_detection_angle(), clamped to the image. image_width is at least 1
+inline uint16_t roiColumn(float angle, float hfov_deg, uint32_t image_width) {
+    float column = (0.5f + angle / hfov_deg) * image_width;
+    return static_cast<uint16_t>(std::min(std::max(column, 0.0f), static_cast<float>(image_width - 1)));
+}
+
+// Hints for scan's clusters within ROI_RANGE_MM that a camera of hfov_deg
+// and image_width columns can see, most urgent first. Returns the count.
+inline int buildRoiHints(const ScanBins& scan, float hfov_deg, uint32_t image_width, RoiHint* out, int maxCount) {
+    float halfFov = 0.5f * hfov_deg;
+    int count = 0;
+    for (int i = 0; i < scan.cluster_count; i++) {
+        const ScanCluster& cluster = scan.clusters[i];
+        float lower = std::max(cluster.min_angle_deg - static_cast<float>(ROI_MARGIN_DEG), -halfFov);
+        float upper = std::min(cluster.max_angle_deg + static_cast<float>(ROI_MARGIN_DEG), halfFov);
+        if (cluster.min_mm >= ROI_RANGE_MM || lower > upper) continue;
+
+        RoiHint hint = {};
+        hint.min_angle_deg = lower;
+        hint.max_angle_deg = upper;
+        hint.range_mm = cluster.min_mm;
+        hint.column_min = roiColumn(lower, hfov_deg, image_width);
+        hint.column_max = roiColumn(upper, hfov_deg, image_width);
+        hint.priority = static_cast<uint8_t>(lroundf(255.0f * (1.0f - cluster.min_mm / static_cast<float>(ROI_RANGE_MM))));
+
+        // Insertion into the sorted prefix, dropping the least urgent when full
+        int at = count < maxCount ? count++ : maxCount;
+        while (at > 0 && out[at - 1].priority < hint.priority) {
+            if (at < maxCount) out[at] = out[at - 1];
+            at--;
+        }
+        if (at < maxCount) out[at] = hint;
+    }
+    return count;
+}
+
+// Nearest return around the vehicle, merged from every sensor's latest
+// scan. Angles are in the vehicle frame: 0 straight ahead and positive to
+// the left, the same convention as a forward-facing sensor's bins.
+const int OCCUPANCY_BINS = static_cast<int>(360.0 / OCCUPANCY_BIN_DEG);
+static_assert(OCCUPANCY_BINS * OCCUPANCY_BIN_DEG == 360.0, "OCCUPANCY_BIN_DEG must divide 360");
+static_assert(MAX_SENSORS < 255, "Occupancy cells store the sensor index in a byte");
+
+const uint8_t OCCUPANCY_NO_SENSOR = 0xFF;
+
+struct OccupancyCell {
+    float range_mm;            // Valid when sensor != OCCUPANCY_NO_SENSOR
+    uint64_t capture_ns;       // steady_clock time the return was measured
+    uint8_t sensor;            // Index of the sensor that saw it
+};
+
+const int OCCUPANCY_RANGE_BINS = MAX_DISTANCE_LIMIT_MM / OCCUPANCY_RANGE_BIN_MM;
+static_assert(OCCUPANCY_RANGE_BINS * OCCUPANCY_RANGE_BIN_MM == MAX_DISTANCE_LIMIT_MM,
+              "OCCUPANCY_RANGE_BIN_MM must divide MAX_DISTANCE_LIMIT_MM");
+static_assert(OCCUPANCY_HIT > 0 && OCCUPANCY_HIT <= 255 && OCCUPANCY_THRESHOLD <= 255,
+              "Occupancy evidence is a byte");
+
+// The grid persists across fuses. Every angle × range bin holds evidence
+// that decays exponentially and is topped up by each return landing in it;
+// cells[] summarises it as the nearest occupied range per angle, so an
+// obstacle outlives a missed revolution or a sensor dropping out of fusion
+// for a few hundred milliseconds instead of blinking out.
+struct PolarOccupancy {
+    OccupancyCell cells[OCCUPANCY_BINS];  // Cell i is centred on occupancyAngle(i)
+    uint64_t fused_ns = 0;     // steady_clock time of the last fuse
+    // Angle-major, so one cell's range bins are contiguous and the decay
+    // pass is a single run over the array
+    alignas(16) uint8_t evidence[OCCUPANCY_BINS * OCCUPANCY_RANGE_BINS] = {};
+    float fresh_mm[OCCUPANCY_BINS];       // Nearest return of the fuse in progress, 0 for none
+    uint8_t fresh_sensor[OCCUPANCY_BINS];
+    uint64_t fresh_ns[OCCUPANCY_BINS];
+};
+
+// Cell holding a vehicle-frame angle in degrees, any value
+inline int occupancyIndex(float angle) {
+    int index = static_cast<int>(lroundf(angle / OCCUPANCY_BIN_DEG)) % OCCUPANCY_BINS;
+    return index < 0 ? index + OCCUPANCY_BINS : index;
+}
+
+// Centre angle of a cell, in (-180, 180]
+inline float occupancyAngle(int index) {
+    float angle = index * static_cast<float>(OCCUPANCY_BIN_DEG);
+    return angle > 180.0f ? angle - 360.0f : angle;
+}
+
+inline int occupancyRangeBin(float range_mm) {
+    int bin = static_cast<int>(range_mm * (1.0f / OCCUPANCY_RANGE_BIN_MM));
+    return std::min(std::max(bin, 0), OCCUPANCY_RANGE_BINS - 1);
+}
+
+inline void clearOccupancy(PolarOccupancy& grid) {
+    for (OccupancyCell& cell : grid.cells) cell.sensor = OCCUPANCY_NO_SENSOR;
+    std::fill(std::begin(grid.evidence), std::end(grid.evidence), 0);
+    grid.fused_ns = 0;
+}
+
+// Scale every evidence byte by keep/256
+inline void decayEvidence(uint8_t* evidence, size_t count, uint8_t keep) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    const uint8x8_t factor = vdup_n_u8(keep);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vld1q_u8(evidence + i);
+        uint8x8_t lo = vshrn_n_u16(vmull_u8(vget_low_u8(v), factor), 8);
+        uint8x8_t hi = vshrn_n_u16(vmull_u8(vget_high_u8(v), factor), 8);
+        vst1q_u8(evidence + i, vcombine_u8(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        evidence[i] = static_cast<uint8_t>((evidence[i] * keep) >> 8);
+    }
+}
+
+// Start a fuse at now_ns: decay the evidence for the time since the last one
+// and forget the previous fuse's returns. Follow with fuseScan() for each
+// sensor and finish with endOccupancyUpdate().
+inline void beginOccupancyUpdate(PolarOccupancy& grid, uint64_t now_ns) {
+    if (grid.fused_ns != 0 && now_ns > grid.fused_ns) {
+        double elapsed_ms = (now_ns - grid.fused_ns) / 1e6;
+        long keep = lround(256.0 * exp(-elapsed_ms / OCCUPANCY_DECAY_MS));
+        if (keep < 256) {
+            decayEvidence(grid.evidence, sizeof(grid.evidence), static_cast<uint8_t>(keep));
+        }
+    }
+    std::fill(std::begin(grid.fresh_mm), std::end(grid.fresh_mm), 0.0f);
+}
+
+// Merge one sensor's scan, mounted with its 0 degrees facing mount_yaw_deg in
+// the vehicle frame (180 for a rear-facing LiDAR). Every cell a bucket
+// overlaps gains evidence at the bucket's range and remembers the nearest
+// range any sensor reported for it this fuse.
+inline void fuseScan(PolarOccupancy& grid, const ScanBins& scan, float mount_yaw_deg, uint8_t sensor) {
+    const ScanGeometry& geometry = scan.geometry;
+    int span = std::max(1, static_cast<int>(lroundf(geometry.bucket_size_deg / OCCUPANCY_BIN_DEG)));
+    for (int b = 0; b < geometry.num_buckets; b++) {
+        if (!isBinValid(scan, b)) continue;
+        const AngleBin& bin = scan.bins[b];
+        int rangeBin = occupancyRangeBin(bin.distance_mm);
+
+        // Cells centred inside the bucket, starting from its lower edge
+        float lower = bucketIndexToAngle(geometry, b) + mount_yaw_deg - 0.5f * geometry.bucket_size_deg;
+        int first = occupancyIndex(lower + 0.5f * static_cast<float>(OCCUPANCY_BIN_DEG));
+        for (int k = 0; k < span; k++) {
+            int c = (first + k) % OCCUPANCY_BINS;
+            uint8_t& evidence = grid.evidence[c * OCCUPANCY_RANGE_BINS + rangeBin];
+            evidence = static_cast<uint8_t>(std::min(255, evidence + OCCUPANCY_HIT));
+            if (grid.fresh_mm[c] == 0.0f || bin.distance_mm < grid.fresh_mm[c]) {
+                grid.fresh_mm[c] = bin.distance_mm;
+                grid.fresh_ns[c] = bin.capture_ns;
+                grid.fresh_sensor[c] = sensor;
+            }
+        }
+    }
+}
+
+// Finish a fuse started at now_ns, settling each cell's range. A fresh
+// return replaces the held range when it is nearer or in the same range bin
+// (the obstacle moved a little); a farther one only does once the held
+// range's evidence has decayed below OCCUPANCY_THRESHOLD, so a revolution
+// that misses a close obstacle does not briefly report the wall behind it.
+inline void endOccupancyUpdate(PolarOccupancy& grid, uint64_t now_ns) {
+    for (int c = 0; c < OCCUPANCY_BINS; c++) {
+        OccupancyCell& cell = grid.cells[c];
+        const uint8_t* evidence = grid.evidence + c * OCCUPANCY_RANGE_BINS;
+        bool held = cell.sensor != OCCUPANCY_NO_SENSOR &&
+                    evidence[occupancyRangeBin(cell.range_mm)] >= OCCUPANCY_THRESHOLD;
+        float fresh = grid.fresh_mm[c];
+        if (fresh != 0.0f && (!held || fresh < cell.range_mm ||
+                              occupancyRangeBin(fresh) == occupancyRangeBin(cell.range_mm))) {
+            cell.range_mm = fresh;
+            cell.capture_ns = grid.fresh_ns[c];
+            cell.sensor = grid.fresh_sensor[c];
+        } else if (!held) {
+            cell.sensor = OCCUPANCY_NO_SENSOR;
+        }
+    }
+    grid.fused_ns = now_ns;
+}
+
+// Nearest range held within half_width_deg of a vehicle-frame angle, or 0
+// when the grid has nothing there
+inline float occupancyRange(const PolarOccupancy& grid, float angle, float half_width_deg) {
+    int first = occupancyIndex(angle - half_width_deg);
+    int span = static_cast<int>(lroundf(2.0f * half_width_deg / OCCUPANCY_BIN_DEG)) + 1;
+    float nearest = 0.0f;
+    for (int k = 0; k < span && k < OCCUPANCY_BINS; k++) {
+        const OccupancyCell& cell = grid.cells[(first + k) % OCCUPANCY_BINS];
+        if (cell.sensor != OCCUPANCY_NO_SENSOR && (nearest == 0.0f || cell.range_mm < nearest)) {
+            nearest = cell.range_mm;
+        }
+    }
+    return nearest;
+}
+
+// Minimal pull parser over a detection message. It understands just enough
+// JSON to find "detections" and pull four fields out of each entry; anything
+// else is skipped without building a DOM or allocating.
+struct JsonCursor {
+    const char* p;
+    const char* end;
+};
+
+inline void skipJsonWhitespace(JsonCursor& c) {
+    while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\n' || *c.p == '\r')) c.p++;
+}
+
+inline bool consumeJsonChar(JsonCursor& c, char expected) {
+    skipJsonWhitespace(c);
+    if (c.p < c.end && *c.p == expected) {
+        c.p++;
+        return true;
+    }
+    return false;
+}
+
+// Parse a string into out (truncated to outSize - 1), or skip it if out is null
+inline bool parseJsonString(JsonCursor& c, char* out, size_t outSize) {
+    if (!consumeJsonChar(c, '"')) return false;
+    size_t n = 0;
+    while (c.p < c.end && *c.p != '"') {
+        char ch = *c.p++;
+        if (ch == '\\') {
+            if (c.p >= c.end) return false;
+            char esc = *c.p++;
+            switch (esc) {
+                case 'b': ch = '\b'; break;
+                case 'f': ch = '\f'; break;
+                case 'n': ch = '\n'; break;
+                case 'r': ch = '\r'; break;
+                case 't': ch = '\t'; break;
+                case 'u': {
+                    // Labels are ASCII; keep ASCII code points, replace the rest
+                    if (c.end - c.p < 4) return false;
+                    unsigned code = 0;
+                    for (int k = 0; k < 4; k++) {
+                        if (!isxdigit(static_cast<unsigned char>(c.p[k]))) return false;
+                        code = code * 16 + (isdigit(static_cast<unsigned char>(c.p[k])) ?
+                                            c.p[k] - '0' : (tolower(c.p[k]) - 'a' + 10));
+                    }
+                    c.p += 4;
+                    ch = code < 0x80 ? static_cast<char>(code) : '?';
+                    break;
+                }
+                default: ch = esc; break;  // \" \\ \/
+            }
+        }
+        if (out && n + 1 < outSize) out[n++] = ch;
+    }
+    if (c.p >= c.end) return false;
+    c.p++;  // closing quote
+    if (out) out[n] = '\0';
+    return true;
+}
+
+// Copy a number token into buf (terminated); returns its length, 0 if none
+inline size_t scanJsonNumber(JsonCursor& c, char* buf, size_t bufSize) {
+    skipJsonWhitespace(c);
+    size_t n = 0;
+    while (c.p < c.end && n + 1 < bufSize &&
+           (isdigit(static_cast<unsigned char>(*c.p)) || *c.p == '-' || *c.p == '+' ||
+            *c.p == '.' || *c.p == 'e' || *c.p == 'E')) {
+        buf[n++] = *c.p++;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+inline bool parseJsonNumber(JsonCursor& c, float& value) {
+    char buf[32];
+    size_t n = scanJsonNumber(c, buf, sizeof(buf));
+    if (n == 0) return false;
+    char* parsed_end;
+    value = strtof(buf, &parsed_end);
+    return parsed_end == buf + n;
+}
+
+// Double precision, for epoch timestamps in seconds
+inline bool parseJsonNumber(JsonCursor& c, double& value) {
+    char buf[32];
+    size_t n = scanJsonNumber(c, buf, sizeof(buf));
+    if (n == 0) return false;
+    char* parsed_end;
+    value = strtod(buf, &parsed_end);
+    return parsed_end == buf + n;
+}
+
+// Epoch seconds as sent by the camera (time.time()) to microseconds, 0 if unusable
+inline uint64_t secondsToTimestampUs(double seconds) {
+    return seconds > 0.0 ? static_cast<uint64_t>(seconds * 1e6) : 0;
+}
+
+// Skip any JSON value, including nested arrays and objects
+inline bool skipJsonValue(JsonCursor& c, int depth = 0) {
+    if (depth > 16) return false;
+    skipJsonWhitespace(c);
+    if (c.p >= c.end) return false;
+
+    char ch = *c.p;
+    if (ch == '"') return parseJsonString(c, nullptr, 0);
+    if (ch == '{' || ch == '[') {
+        char close = (ch == '{') ? '}' : ']';
+        c.p++;
+        if (consumeJsonChar(c, close)) return true;
+        do {
+            if (ch == '{' && (!parseJsonString(c, nullptr, 0) || !consumeJsonChar(c, ':'))) return false;
+            if (!skipJsonValue(c, depth + 1)) return false;
+        } while (consumeJsonChar(c, ','));
+        return consumeJsonChar(c, close);
+    }
+    if (ch == 't' || ch == 'f' || ch == 'n') {
+        while (c.p < c.end && isalpha(static_cast<unsigned char>(*c.p))) c.p++;
+        return true;
+    }
+    float ignored;
+    return parseJsonNumber(c, ignored);
+}
+
+// Parse one entry of the detections array
+inline bool parseJsonDetection(JsonCursor& c, CameraDetection& det) {
+    det.label[0] = '\0';
+    det.confidence = 0.0f;
+    det.angle_deg = 0.0f;
+    det.area = 0.0f;
+
+    if (!consumeJsonChar(c, '{')) return false;
+    if (consumeJsonChar(c, '}')) return true;
+    do {
+        char key[16];
+        if (!parseJsonString(c, key, sizeof(key)) || !consumeJsonChar(c, ':')) return false;
+
+        bool ok;
+        if (strcmp(key, "label") == 0) ok = parseJsonString(c, det.label, sizeof(det.label));
+        else if (strcmp(key, "confidence") == 0) ok = parseJsonNumber(c, det.confidence);
+        else if (strcmp(key, "angle_deg") == 0) ok = parseJsonNumber(c, det.angle_deg);
+        else if (strcmp(key, "area") == 0) ok = parseJsonNumber(c, det.area);
+        else ok = skipJsonValue(c);
+        if (!ok) return false;
+    } while (consumeJsonChar(c, ','));
+    return consumeJsonChar(c, '}');
+}
+
+// Fast path: returns the number of detections, or -1 if the message needs the DOM fallback
+inline int parseDetectionsFast(const char* data, size_t size, CameraDetection* out, int maxCount,
+                               uint64_t& timestamp_us) {
+    JsonCursor c = { data, data + size };
+    int count = -1;
+
+    if (!consumeJsonChar(c, '{')) return -1;
+    if (consumeJsonChar(c, '}')) return -1;
+    do {
+        char key[16];
+        if (!parseJsonString(c, key, sizeof(key)) || !consumeJsonChar(c, ':')) return -1;
+
+        if (strcmp(key, "timestamp") == 0) {
+            double seconds;
+            if (!parseJsonNumber(c, seconds)) return -1;
+            timestamp_us = secondsToTimestampUs(seconds);
+            continue;
+        }
+        if (strcmp(key, "detections") != 0) {
+            if (!skipJsonValue(c)) return -1;
+            continue;
+        }
+
+        if (!consumeJsonChar(c, '[')) return -1;
+        count = 0;
+        if (consumeJsonChar(c, ']')) continue;
+        do {
+            CameraDetection scratch;
+            CameraDetection& det = (count < maxCount) ? out[count] : scratch;
+            if (!parseJsonDetection(c, det)) return -1;
+            if (count < maxCount) count++;
+        } while (consumeJsonChar(c, ','));
+        if (!consumeJsonChar(c, ']')) return -1;
+    } while (consumeJsonChar(c, ','));
+
+    return consumeJsonChar(c, '}') ? count : -1;
+}
+
+// Fallback: full jsoncpp parse for anything the fast path rejects
+inline int parseDetectionsDom(const char* data, size_t size, CameraDetection* out, int maxCount,
+                              uint64_t& timestamp_us) {
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(data, data + size, root, false) || !root.isMember("detections") || !root["detections"].isArray()) {
+        return -1;
+    }
+    if (root["timestamp"].isNumeric()) {
+        timestamp_us = secondsToTimestampUs(root["timestamp"].asDouble());
+    }
+
+    int count = 0;
+    for (const auto& det : root["detections"]) {
+        if (count >= maxCount) break;
+        CameraDetection& d = out[count++];
+        std::string label = det.get("label", "").asString();
+        strncpy(d.label, label.c_str(), sizeof(d.label) - 1);
+        d.label[sizeof(d.label) - 1] = '\0';
+        d.confidence = det.get("confidence", 0.0f).asFloat();
+        d.angle_deg = det.get("angle_deg", 0.0f).asFloat();
+        d.area = det.get("area", 0.0f).asFloat();
+    }
+    return count;
+}
+
+// Compact binary detections: DetectionFrameHeader followed by DetectionRecords
+inline int parseDetectionsBinary(const char* data, size_t size, CameraDetection* out, int maxCount,
+                                 uint64_t& timestamp_us) {
+    DetectionFrameHeader header;
+    if (size < sizeof(header)) return -1;
+    memcpy(&header, data, sizeof(header));
+    if (header.version != DETECTION_FRAME_VERSION ||
+        size < sizeof(header) + static_cast<size_t>(header.count) * sizeof(DetectionRecord)) {
+        return -1;
+    }
+
+    timestamp_us = header.timestamp_us;
+    int count = std::min(static_cast<int>(header.count), maxCount);
+    const char* records = data + sizeof(header);
+    for (int i = 0; i < count; i++) {
+        DetectionRecord record;
+        memcpy(&record, records + i * sizeof(record), sizeof(record));
+        CameraDetection& d = out[i];
+        size_t labelLen = strnlen(record.label, sizeof(record.label));
+        memcpy(d.label, record.label, labelLen);
+        d.label[labelLen] = '\0';
+        d.confidence = record.confidence;
+        d.angle_deg = record.angle_deg;
+        d.area = record.area;
+    }
+    return count;
+}
+
+// Decode any supported detection message into g_detections and
+// g_detections_timestamp_us
+inline int parseDetections(const char* data, size_t size) {
+    int count;
+    g_detections_timestamp_us = 0;
+    if (size >= 4 && memcmp(data, DETECTION_FRAME_MAGIC, 4) == 0) {
+        count = parseDetectionsBinary(data, size, g_detections, MAX_DETECTIONS, g_detections_timestamp_us);
+    } else {
+        count = parseDetectionsFast(data, size, g_detections, MAX_DETECTIONS, g_detections_timestamp_us);
+        if (count < 0) {
+            g_detections_timestamp_us = 0;
+            count = parseDetectionsDom(data, size, g_detections, MAX_DETECTIONS, g_detections_timestamp_us);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        g_detections[i].class_id = lookupClassId(g_detections[i].label);
+    }
+    return count;
+}
+
+// One IMU message, as published by ToF-and-IMU/publish_tof_and_imu:
+// {"timestamp": <epoch s>, "imu": {"yaw": <rad/s>, ...}, "speed_mps": <m/s>}.
+// speed_mps is optional, for a wheel sensor; it is negative when missing.
+struct ImuReading {
+    uint64_t timestamp_us;     // 0 if not sent
+    float yaw_rate_dps;        // Counter-clockwise seen from above (turning left) is positive
+    float speed_mps;
+};
+
+// Parse an IMU message without allocating; false if it has no yaw rate
+inline bool parseImuMessage(const char* data, size_t size, ImuReading& out) {
+    JsonCursor c = { data, data + size };
+    bool have_yaw = false;
+    out = { 0, 0.0f, -1.0f };
+
+    if (!consumeJsonChar(c, '{')) return false;
+    if (consumeJsonChar(c, '}')) return false;
+    do {
+        char key[16];
+        if (!parseJsonString(c, key, sizeof(key)) || !consumeJsonChar(c, ':')) return false;
+
+        if (strcmp(key, "timestamp") == 0) {
+            double seconds;
+            if (!parseJsonNumber(c, seconds)) return false;
+            out.timestamp_us = secondsToTimestampUs(seconds);
+        } else if (strcmp(key, "speed_mps") == 0) {
+            if (!parseJsonNumber(c, out.speed_mps)) return false;
+        } else if (strcmp(key, "imu") == 0) {
+            if (!consumeJsonChar(c, '{')) return false;
+            if (consumeJsonChar(c, '}')) continue;
+            do {
+                if (!parseJsonString(c, key, sizeof(key)) || !consumeJsonChar(c, ':')) return false;
+                if (strcmp(key, "yaw") == 0) {
+                    float rad_s;
+                    if (!parseJsonNumber(c, rad_s)) return false;
+                    out.yaw_rate_dps = rad_s * static_cast<float>(180.0 / M_PI);
+                    have_yaw = true;
+                } else if (!skipJsonValue(c)) {
+                    return false;
+                }
+            } while (consumeJsonChar(c, ','));
+            if (!consumeJsonChar(c, '}')) return false;
+        } else if (!skipJsonValue(c)) {
+            return false;
+        }
+    } while (consumeJsonChar(c, ','));
+
+    return consumeJsonChar(c, '}') && have_yaw;
+}
+
+// Recent yaw rates on the steady clock. Written by the IMU thread only and
+// read by every acquisition thread; readers skip slots overwritten while
+// they were reading.
+struct ImuHistory {
+    struct Slot {
+        std::atomic<uint64_t> t_ns;
+        std::atomic<float> yaw_rate_dps;
+    };
+    Slot slots[IMU_HISTORY];
+    std::atomic<uint64_t> count{0};
+};
+
+inline ImuHistory g_imu;
+
+inline void recordImuSample(ImuHistory& history, uint64_t t_ns, float yaw_rate_dps) {
+    uint64_t n = history.count.load(std::memory_order_relaxed);
+    ImuHistory::Slot& slot = history.slots[n % IMU_HISTORY];
+    slot.t_ns.store(0, std::memory_order_relaxed);  // Readers ignore the slot while it changes
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.yaw_rate_dps.store(yaw_rate_dps, std::memory_order_relaxed);
+    slot.t_ns.store(t_ns, std::memory_order_release);
+    history.count.store(n + 1, std::memory_order_release);
+}
+
+// Mean yaw rate over [from_ns, to_ns]. With no sample inside, the latest
+// one before from_ns stands in if it is at most IMU_MAX_AGE_MS older. False
+// when there is no usable sample.
+inline bool meanYawRate(const ImuHistory& history, uint64_t from_ns, uint64_t to_ns, float& out) {
+    uint64_t n = history.count.load(std::memory_order_acquire);
+    float sum = 0.0f;
+    int samples = 0;
+    uint64_t latest_ns = 0;
+    float latest_rate = 0.0f;
+    for (uint64_t k = n; k > 0 && n - k < IMU_HISTORY; k--) {
+        const ImuHistory::Slot& slot = history.slots[(k - 1) % IMU_HISTORY];
+        uint64_t t_ns = slot.t_ns.load(std::memory_order_acquire);
+        float rate = slot.yaw_rate_dps.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (t_ns == 0 || t_ns != slot.t_ns.load(std::memory_order_relaxed)) continue;
+        if (t_ns < from_ns) {
+            if (latest_ns == 0) { latest_ns = t_ns; latest_rate = rate; }
+            break;  // Older samples only get further from the window
+        }
+        if (t_ns > to_ns) continue;
+        sum += rate;
+        samples++;
+    }
+    if (samples > 0) {
+        out = sum / samples;
+        return true;
+    }
+    if (latest_ns != 0 && from_ns - latest_ns <= IMU_MAX_AGE_MS * 1000000ULL) {
+        out = latest_rate;
+        return true;
+    }
+    return false;
+}
+
+// Fixed-point node geometry. HQ nodes carry the angle as q14 with
+// 90 degrees = 1 << 14 (a revolution is 1 << 16) and the distance as q2
+// (mm * 4), so the per-node filter and bucketing stay in integers and only
+// points that are kept get converted to floats.
+const uint16_t ARC_HALF_Q14 = static_cast<uint16_t>(FRONT_ARC_DEG / 90.0 * (1 << 14));
+const uint16_t ARC_SPAN_Q14 = static_cast<uint16_t>(2 * ARC_HALF_Q14);
+const uint16_t MIN_DISTANCE_Q2 = MIN_DISTANCE_MM * 4;
+static_assert(FRONT_ARC_DEG > 0.0 && FRONT_ARC_DEG < 180.0, "FRONT_ARC_DEG must be below 180");
+
+// Per-node codes from classifyNode(): the bucket index, flagged when the
+// node has no usable distance
+const uint16_t NODE_BUCKET_MASK = 0x3FFF;
+const uint16_t NODE_OUT_OF_RANGE = 0x4000;  // Outside the distance limits; splits clusters
+const uint16_t NODE_NO_RETURN = 0x8000;     // Distance 0; skipped
+const uint16_t NODE_OUTSIDE_ARC = 0xFFFF;   // Behind the front arc
+
+// Degrees for a node already known to be inside the front arc
+inline float arcAngleDegrees(uint16_t angle_z_q14) {
+    uint16_t t = static_cast<uint16_t>(ARC_HALF_Q14 - angle_z_q14);
+    return (static_cast<int>(t) - ARC_HALF_Q14) * (90.0f / (1 << 14));
+}
+
+// Scalar reference for the NEON kernel in classifyNodes()
+inline uint16_t classifyNode(const ScanGeometry& geometry, const sl_lidar_response_measurement_node_hq_t& node) {
+    // Position along the arc: 0 at +FRONT_ARC_DEG, ARC_SPAN_Q14 at -FRONT_ARC_DEG
+    uint16_t t = static_cast<uint16_t>(ARC_HALF_Q14 - node.angle_z_q14);
+    if (t > ARC_SPAN_Q14) {
+        return NODE_OUTSIDE_ARC;
+    }
+    uint16_t code = static_cast<uint16_t>((t * static_cast<uint32_t>(geometry.bucket_recip_q16) + 0x8000) >> 16);
+    uint32_t dist = node.dist_mm_q2;
+    if (dist == 0) {
+        code |= NODE_NO_RETURN;
+    } else if (dist < MIN_DISTANCE_Q2 || dist > geometry.max_distance_q2) {
+        code |= NODE_OUT_OF_RANGE;
+    }
+    return code;
+}
+
+inline void classifyNodes(const ScanGeometry& geometry, const sl_lidar_response_measurement_node_hq_t* nodes,
+                          size_t count, uint16_t* codes) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    static_assert(sizeof(sl_lidar_response_measurement_node_hq_t) == 8, "NEON path expects packed 8-byte nodes");
+    const uint16x8_t arcHalf = vdupq_n_u16(ARC_HALF_Q14);
+    const uint16x8_t arcSpan = vdupq_n_u16(ARC_SPAN_Q14);
+    const uint16x8_t minDist = vdupq_n_u16(MIN_DISTANCE_Q2);
+    const uint16x8_t maxDist = vdupq_n_u16(geometry.max_distance_q2);
+    const uint16_t recip = geometry.bucket_recip_q16;
+    const uint16x8_t zero = vdupq_n_u16(0);
+    const uint16x8_t noReturnFlag = vdupq_n_u16(NODE_NO_RETURN);
+    const uint16x8_t outOfRangeFlag = vdupq_n_u16(NODE_OUT_OF_RANGE);
+    const uint32x4_t roundHalf = vdupq_n_u32(0x8000);
+    for (; i + 8 <= count; i += 8) {
+        // De-interleave 8 nodes into angle, distance low/high halves and quality|flag
+        uint16x8x4_t v = vld4q_u16(reinterpret_cast<const uint16_t*>(nodes + i));
+        uint16x8_t t = vsubq_u16(arcHalf, v.val[0]);
+        uint16x8_t outside = vcgtq_u16(t, arcSpan);
+
+        uint32x4_t lo = vaddq_u32(vmull_n_u16(vget_low_u16(t), recip), roundHalf);
+        uint32x4_t hi = vaddq_u32(vmull_n_u16(vget_high_u16(t), recip), roundHalf);
+        uint16x8_t code = vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+
+        uint16x8_t highZero = vceqq_u16(v.val[2], zero);
+        uint16x8_t noReturn = vandq_u16(highZero, vceqq_u16(v.val[1], zero));
+        uint16x8_t inRange = vandq_u16(highZero, vandq_u16(vcgeq_u16(v.val[1], minDist), vcleq_u16(v.val[1], maxDist)));
+        code = vorrq_u16(code, vandq_u16(noReturn, noReturnFlag));
+        code = vorrq_u16(code, vbicq_u16(outOfRangeFlag, vorrq_u16(inRange, noReturn)));
+        code = vorrq_u16(code, outside);
+        vst1q_u16(codes + i, code);
+    }
+#endif
+    for (; i < count; i++) {
+        codes[i] = classifyNode(geometry, nodes[i]);
+    }
+}
+
+// The vehicle's motion over one revolution, assumed steady
+struct EgoMotion {
+    float yaw_rate_dps;        // Counter-clockwise (turning left) is positive
+    float speed_mm_s;          // Forward
+};
+
+// sin() over a revolution in SINE_TABLE_SIZE steps, indexed by q14 angle
+// >> SINE_TABLE_SHIFT; cos is a quarter turn further along
+const int SINE_TABLE_SHIFT = 4;
+const int SINE_TABLE_SIZE = (1 << 16) >> SINE_TABLE_SHIFT;
+
+inline const float* sineTable() {
+    static float table[SINE_TABLE_SIZE];
+    static const bool filled = [] {
+        for (int i = 0; i < SINE_TABLE_SIZE; i++) table[i] = static_cast<float>(sin(2.0 * M_PI * i / SINE_TABLE_SIZE));
+        return true;
+    }();
+    (void)filled;
+    return table;
+}
+
+// atan(z) for |z| <= 1, within 1e-5 rad
+inline float atanUnit(float z) {
+    float z2 = z * z;
+    return z * (0.99997726f + z2 * (-0.33262347f + z2 * (0.19354346f + z2 * (-0.11643287f +
+                z2 * (0.05265332f + z2 * -0.01172120f)))));
+}
+
+// Move every node of a grabbed revolution to where the sensor would have
+// seen it at timing.end_ns, undoing the turn and forward travel since it
+// was measured. mount_yaw_deg is where the sensor's 0 degrees faces, CCW
+// from straight ahead. Nodes outside the sensor's front arc by more than
+// the turn can bring back are left alone, since binning drops them anyway.
+// With travel that only holds for a forward-facing sensor: forward travel
+// moves points away from straight ahead, out of its arc. For the rest,
+// turning is an add per node; travel adds a table lookup, a square root and
+// a short polynomial. BM_DeskewScan puts a turning, moving revolution at
+// about binning's cost for a forward sensor and 1.5-2x for a rear one.
+inline void deskewScan(sl_lidar_response_measurement_node_hq_t* nodes, size_t count, const ScanTiming& timing,
+                       const EgoMotion& motion, float mount_yaw_deg) {
+    const float Q14_PER_DEG = (1 << 14) / 90.0f;
+    const float Q14_PER_RAD = static_cast<float>(Q14_PER_DEG * 180.0 / M_PI);
+    float period_s = timing.period_ns * 1e-9f;
+    bool turning = std::abs(motion.yaw_rate_dps) * period_s >= DESKEW_MIN_TURN_DEG;
+    bool travelling = std::abs(motion.speed_mm_s) * period_s >= DESKEW_MIN_TRAVEL_MM;
+    if (!turning && !travelling) return;
+
+    // Raw angles run clockwise from the sensor's 0, so straight ahead is at
+    // raw mount_yaw_deg, and a left turn since a node was measured adds to
+    // its angle. Travel d moves a point at raw a and range r to bearing
+    // a + atan2(d sin(a - m), r - d cos(a - m)).
+    const float* sine = sineTable();
+    uint16_t forward_q14 = static_cast<uint16_t>(static_cast<int32_t>(lroundf(mount_yaw_deg * Q14_PER_DEG)));
+    float turn_q14_per_s = motion.yaw_rate_dps * Q14_PER_DEG;
+
+    // Arc test as in classifyNode(), widened by the turn over a revolution
+    // plus a degree of rounding
+    uint32_t margin_q14 = static_cast<uint32_t>(std::abs(turn_q14_per_s) * period_s + Q14_PER_DEG);
+    bool forwardFacing = std::abs(remainderf(mount_yaw_deg, 360.0f)) < 0.5f;
+    bool skipOutside = (!travelling || (forwardFacing && motion.speed_mm_s >= 0.0f)) &&
+                       ARC_SPAN_Q14 + 2 * margin_q14 < (1u << 16);
+    uint16_t arcHalf = static_cast<uint16_t>(ARC_HALF_Q14 + margin_q14);
+    uint32_t arcSpan = ARC_SPAN_Q14 + 2 * margin_q14;
+
+    for (size_t i = 0; i < count; i++) {
+        sl_lidar_response_measurement_node_hq_t& node = nodes[i];
+        if (skipOutside && static_cast<uint16_t>(arcHalf - node.angle_z_q14) > arcSpan) continue;
+        float dt = (timing.end_ns - nodeCaptureTime(timing, node.angle_z_q14)) * 1e-9f;
+        float shift_q14 = turn_q14_per_s * dt;
+
+        if (travelling && node.dist_mm_q2 != 0) {
+            int index = static_cast<uint16_t>(node.angle_z_q14 - forward_q14) >> SINE_TABLE_SHIFT;
+            float s = sine[index];
+            float c = sine[(index + SINE_TABLE_SIZE / 4) & (SINE_TABLE_SIZE - 1)];
+            float r = node.dist_mm_q2 * 0.25f;
+            float travel = motion.speed_mm_s * dt;
+            float x = r - travel * c;
+            float y = travel * s;
+            float bend = (x > 0.0f && std::abs(y) <= x) ? atanUnit(y / x) : atan2f(y, x);
+            shift_q14 += bend * Q14_PER_RAD;
+            node.dist_mm_q2 = std::max<uint32_t>(1, static_cast<uint32_t>(sqrtf(x * x + y * y) * 4.0f + 0.5f));
+        }
+        int32_t shift = static_cast<int32_t>(shift_q14 + (shift_q14 >= 0.0f ? 0.5f : -0.5f));
+        node.angle_z_q14 = static_cast<uint16_t>(node.angle_z_q14 + shift);
+    }
+}
+
+// Bin and cluster one ascended revolution into scan, stamping bins and
+// clusters with the capture time of their closest point
+inline void binScan(ScanContext& context, ScanBins& scan, const sl_lidar_response_measurement_node_hq_t* nodes,
+                    size_t count, const ScanTiming& timing) {
+    uint16_t* codes = context.codes;
+    count = std::min(count, static_cast<size_t>(MAX_SCAN_NODES));
+
+    // Start a new generation of angle bins
+    beginScanBins(context, scan);
+    const ScanGeometry& geometry = scan.geometry;
+    classifyNodes(geometry, nodes, count, codes);
+    uint16_t minQ2[MAX_ANGLE_BUCKETS];
+    uint16_t minNode[MAX_ANGLE_BUCKETS];
+    std::fill(minQ2, minQ2 + geometry.num_buckets, UINT16_MAX);
+    static_assert(MAX_SCAN_NODES <= 65536, "minNode holds 16-bit node indices");
+
+    // Walk the front arc contiguously for clustering: start at the left
+    // edge (raw 360 - FRONT_ARC_DEG) and wrap through raw 0 to the right edge
+    size_t start = 0;
+    while (start < count && nodes[start].angle_z_q14 < (1u << 16) - ARC_HALF_Q14) start++;
+
+    ClusterBuilder builder;
+    scan.cluster_count = 0;
+
+    auto visit = [&](size_t i) {
+        uint16_t code = codes[i];
+        if (code == NODE_OUTSIDE_ARC || (code & NODE_OUT_OF_RANGE)) {
+            closeCluster(builder, scan.clusters, scan.cluster_count);
+            return;
+        }
+        if (code & NODE_NO_RETURN) {
+            return;  // The angular gap check handles holes
+        }
+        uint16_t dist = static_cast<uint16_t>(nodes[i].dist_mm_q2);
+        uint16_t angle = nodes[i].angle_z_q14;
+        segmentPoint(builder, arcAngleDegrees(angle), dist * 0.25f, nodeCaptureTime(timing, angle),
+                     scan.clusters, scan.cluster_count);
+
+        // Keep the closest point for each angle bucket
+        if (dist < minQ2[code]) {
+            minQ2[code] = dist;
+            minNode[code] = static_cast<uint16_t>(i);
+        }
+    };
+    for (size_t i = start; i < count; i++) visit(i);
+    for (size_t i = 0; i < start; i++) visit(i);
+    closeCluster(builder, scan.clusters, scan.cluster_count);
+
+    for (int b = 0; b < geometry.num_buckets; b++) {
+        if (minQ2[b] != UINT16_MAX) {
+            updateBin(scan, b, minQ2[b] * 0.25f, nodeCaptureTime(timing, nodes[minNode[b]].angle_z_q14));
+        }
+    }
+
+    // The sweep runs from +FRONT_ARC_DEG down to -FRONT_ARC_DEG
+    std::reverse(scan.clusters, scan.clusters + scan.cluster_count);
+}
+
+// Range of a cluster seen at two times, moved linearly to t_ns. Going past
+// either sighting is limited to one interval so a noisy pair cannot run away.
+inline float rangeAtTime(const ScanCluster& earlier, const ScanCluster& later, uint64_t t_ns) {
+    float span = static_cast<float>(later.capture_ns - earlier.capture_ns);
+    float offset = static_cast<float>(static_cast<int64_t>(t_ns - later.capture_ns));
+    offset = std::max(-2.0f * span, std::min(offset, span));
+    return later.min_mm + (later.min_mm - earlier.min_mm) * (offset / span);
+}
+
+// Range the parsed detections against scan's clusters, filling
+// g_measurements for updateTracks(). Returns the number of measurements.
+// When previous (the scan before, may be null) saw the same object, the
+// range is interpolated or extrapolated to detection_ns, the camera frame's
+// capture time; otherwise the latest sighting is used as is. A detection
+// with no cluster falls back to occupancy (may be null), the fused grid, at
+// its angle turned by mount_yaw_deg, the camera sensor's mounting.
+inline int rangeDetections(const ScanBins& scan, const ScanBins* previous, int detectionCount, uint64_t detection_ns,
+                           const PolarOccupancy* occupancy = nullptr, float mount_yaw_deg = 0.0f) {
+    int measurementCount = 0;
+    for (int i = 0; i < detectionCount; i++) {
+        const CameraDetection& det = g_detections[i];
+
+        // Range the detection with its LiDAR cluster's closest point
+        float angleCam = det.angle_deg;
+        const ScanCluster* cluster = matchCluster(scan, angleCam);
+        if (!cluster) {
+            float held = occupancy ? occupancyRange(*occupancy, angleCam + mount_yaw_deg, OCCUPANCY_MATCH_DEG) : 0.0f;
+            if (held > 0.0f) {
+                g_measurements[measurementCount++] = {i, angleCam, held};
+            }
+            continue;
+        }
+
+        float distance = cluster->min_mm;
+        const ScanCluster* earlier = previous ? matchCluster(*previous, angleCam) : nullptr;
+        if (earlier && earlier->capture_ns < cluster->capture_ns &&
+            cluster->capture_ns - earlier->capture_ns <= RANGE_INTERP_MAX_MS * 1000000ULL &&
+            fabsf(cluster->min_mm - earlier->min_mm) <= TRACK_GATE_MM) {
+            distance = std::max(rangeAtTime(*earlier, *cluster, detection_ns), static_cast<float>(MIN_DISTANCE_MM));
+        }
+
+        // Queue it for the tracker
+        g_measurements[measurementCount++] = {i, angleCam, distance};
+    }
+    return measurementCount;
+}
+
+// Steady clock time of a wall clock timestamp_us on a message received at
+// receive_ns. Without a timestamp, or when it is implausibly old or in the
+// future, the receive time is used.
+inline uint64_t steadyCaptureTime(uint64_t timestamp_us, uint64_t receive_ns) {
+    if (timestamp_us == 0) {
+        return receive_ns;
+    }
+    uint64_t now_us = getCurrentTimeUs();
+    if (timestamp_us > now_us || now_us - timestamp_us > DETECTION_MAX_AGE_MS * 1000ULL) {
+        return receive_ns;
+    }
+    return receive_ns - (now_us - timestamp_us) * 1000;
+}
+
+// Camera capture time on the steady clock for a message received at receive_ns
+inline uint64_t detectionCaptureTime(uint64_t receive_ns) {
+    return steadyCaptureTime(g_detections_timestamp_us, receive_ns);
+}
@@ -0,0 +1,2405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <signal.h>
+#include <zmq.hpp>
+#include <zmq.h>  // For ZMQ constants
+#include <sstream>
+#include <fstream>
+#include <cmath>
+#include "sl_lidar_driver.h"
+#include "lidar_core.h"
+#include "lidar_pipeline.h"
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>  // For std::chrono
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace sl;
+using namespace std;
+
+// Defaults for the settings a --config file can override
+#define SERIAL_PORT "/dev/ttyUSB0"
+#define SERIAL_BAUDRATE 460800
+#define ZMQ_PORT_PUB "5556"      // Raw LIDAR data (a TCP port, or a full endpoint via --config)
+#define ZMQ_PORT_SUB "5555"      // Camera detections
+#define ZMQ_PORT_OBJ "5557"      // Correlated objects
+#define ZMQ_PORT_STATS "5558"    // Pipeline latency statistics
+#define ZMQ_PORT_IMU "5559"      // Yaw rate from ToF-and-IMU/publish_tof_and_imu
+#define ZMQ_PORT_ROI "5560"      // Region-of-interest hints for docker_detection_refined.py
+#define CAMERA_HFOV_DEG 70.4     // Horizontal FOV of the detector's camera (C920: 78 deg diagonal at 16:9)
+#define CAMERA_IMAGE_WIDTH 1280  // Columns of the detector's frames
+#define BATCH_SIZE 50            // Reduced batch size for more frequent updates
+#define INIT_DELAY_MS 2000       // Upper bound on each LiDAR startup wait (2 seconds)
+#define INIT_POLL_MS 50          // Readiness polling interval (and per-request timeout) during startup
+#define SCAN_DELAY_MS 100        // Delay between scan attempts
+#define PUBLISH_LIDAR_DATA true   // Toggle for publishing raw LIDAR data
+#define FORCE_PUBLISH_MS 100     // Force object publishing every 100ms (default, see --config)
+#define KEYFRAME_MS 1000         // --objects-delta: full OBJECTS snapshot every 1s (default, see --config)
+#define STREAM_SECTOR_DEG 30.0   // Streaming mode: publish each time this much of the front arc completes
+#define STREAM_POLL_MS 2         // Streaming mode: wait between partial fetches when no nodes are ready
+#define STREAM_STALL_MS 500      // Streaming mode: treat this long without nodes as a failed grab
+#define IMU_RECV_TIMEOUT_MS 100  // The IMU thread checks for shutdown this often
+#define FUSION_POLL_MS 10        // With several sensors, fuse new scans at least this often
+#define MOTOR_FULL_SPEED_MPS 6.0  // Vehicle speed (m/s) at which the motor runs at its maximum
+#define MOTOR_IDLE_RATIO 0.6      // Stopped: run at this share of the device's default speed, at least its minimum
+#define MOTOR_SPEED_DEADBAND 0.05  // Ignore motor speed changes smaller than this share of the range
+#define GRAB_TIMEOUT_MS 500      // Longest wait for a full revolution before the grab counts as failed
+#define RECONNECT_BACKOFF_MIN_MS 50    // First wait between LiDAR reconnect attempts
+#define RECONNECT_BACKOFF_MAX_MS 500   // Reconnect backoff doubles up to this
+#define OBJECTS_BUFFER_POOL 4      // OBJECTS buffers that can be in flight inside ZMQ at once
+#define OBJECTS_BUFFER_RESERVE 4096  // Initial capacity of each OBJECTS buffer
+#define LIDAR_FRAME_MAGIC "LBIN"  // Topic/magic prefix for binary LIDAR frames
+#define LIDAR_FRAME_VERSION 1     // Bump when the binary frame layout changes
+#define SCAN_SHM_MAGIC "LSHM"     // Marks an initialized shared-memory scan ring
+#define SCAN_SHM_VERSION 1        // Bump when the scan ring layout changes
+#define SCAN_SHM_SLOTS 4          // Frames kept in the scan ring; readers copy the newest
+#define STATS_INTERVAL_MS 1000    // Period of the STATS message
+#define ALERT_BAUDRATE B115200    // Matches Serial.begin() in esp32_tethered.py
+#define ALERT_MIN_INTERVAL_MS 100  // Shortest gap between two alert packets
+#define ALERT_REPEAT_MS 500       // Resend the same alert this often while it lasts...
+#define ALERT_URGENCY_STEP 32     // ... or sooner once its urgency rises this much
+#define ALERT_REOPEN_MS 1000      // Retry a missing or failed alert port this often
+#define FLIGHT_RECORDER_PATH "/tmp/lidar_flight_recorder.bin"  // Written on SIGUSR2 or a crash (default, see --config)
+#define REPLAY_DETECTIONS_ENDPOINT "inproc://replay-detections"  // Replayed detections are published here
+
+PipelineProfile g_profile;           // Deployment this binary was built as, set once in runPipeline()
+
+// Global variables for cleanup
+zmq::context_t* g_context = nullptr;
+zmq::socket_t* g_publisher = nullptr;
+zmq::socket_t* g_subscriber = nullptr;
+zmq::socket_t* g_corr_publisher = nullptr;
+zmq::socket_t* g_stats_publisher = nullptr;  // Used by the correlation thread only
+zmq::socket_t* g_imu_subscriber = nullptr;   // Used by the IMU thread only, nullptr when disabled
+zmq::socket_t* g_roi_publisher = nullptr;    // Used by the correlation thread only, nullptr when disabled
+std::atomic<bool> g_running{true};
+uint64_t g_last_obj_publish_time = 0;  // Monotonic ms of the last objects publish
+std::atomic<bool> g_publish_lidar_data{PUBLISH_LIDAR_DATA};  // Runtime toggle
+bool g_binary_lidar_frames = false;  // Publish packed binary frames instead of text
+bool g_fused_lidar_feed = false;     // Several sensors: LIDAR frames come from the occupancy grid, not per-sensor scans
+uint32_t g_scan_sequence = 0;        // Incremented for every published scan
+bool g_stream_scan = false;          // Default for sensors: process nodes as they arrive instead of per revolution
+std::atomic<int> g_degraded_sensors{0};  // Sensors whose data is stale while acquisition recovers
+std::atomic<uint32_t> g_force_publish_ms{FORCE_PUBLISH_MS};  // Runtime tunable, see --config
+bool g_objects_delta = false;        // Publish OBJECTS_DELTA changes between full OBJECTS keyframes
+uint32_t g_objects_sequence = 0;     // Incremented for every OBJECTS or OBJECTS_DELTA message
+uint64_t g_last_keyframe_time = 0;   // Monotonic ms of the last full OBJECTS message
+std::atomic<uint32_t> g_keyframe_ms{KEYFRAME_MS};                // Runtime tunables, see --config
+std::atomic<float> g_delta_range_mm{DELTA_RANGE_EPSILON_MM};
+std::atomic<float> g_delta_angle_deg{DELTA_ANGLE_EPSILON_DEG};
+std::atomic<float> g_vehicle_speed_mps{-1.0f};  // Negative while unknown; see --config
+char g_flight_recorder_path[256] = FLIGHT_RECORDER_PATH;  // Fixed at startup so signal handlers can read it
+std::atomic<bool> g_dump_flight_recorder{false};  // Set by SIGUSR2, handled by the correlation thread
+
+// One range sensor, from the "sensors" list of the --config file. Without
+// the list there is a single forward-facing LiDAR on serial_port.
+struct SensorConfig {
+    string serial_port = SERIAL_PORT;
+    int serial_baudrate = SERIAL_BAUDRATE;
+    float mount_yaw_deg = 0.0f;  // Where the sensor's 0 degrees faces, CCW from straight ahead
+    bool stream_scan = false;    // As --stream-scan, for this sensor
+};
+
+// Settings loaded from the --config file (JSON). Keys left out keep the
+// compile-time defaults above, as adjusted by profileConfig(). Each zmq_port_* is either a TCP port or a
+// full ZMQ endpoint such as "ipc:///tmp/lidar-scans". The serial ports,
+// sensors, ZMQ endpoints and scan ring are only used at startup; everything
+// else is applied again on SIGHUP.
+struct RuntimeConfig {
+    string serial_port = SERIAL_PORT;
+    int serial_baudrate = SERIAL_BAUDRATE;
+    vector<SensorConfig> sensors;      // Sensor 0 is the one the camera is correlated with
+    string zmq_port_pub = ZMQ_PORT_PUB;
+    string zmq_port_sub = ZMQ_PORT_SUB;
+    string zmq_port_obj = ZMQ_PORT_OBJ;
+    string zmq_port_stats = ZMQ_PORT_STATS;
+    string zmq_port_imu = ZMQ_PORT_IMU;  // Empty to run without the IMU (no turn deskew)
+    string zmq_port_roi = ZMQ_PORT_ROI;  // Empty to send no ROI hints
+    string scan_shm;                   // shm_open() name of the scan ring, e.g. "/lidar-scans"; empty for none
+    string alert_port;                 // Serial device alert packets are written to (the tethered ESP32); empty for none
+    string flight_recorder_path = FLIGHT_RECORDER_PATH;  // Where flight recorder dumps go; empty for none
+    ScanGeometry geometry;             // angle_bucket_size_deg, max_distance_mm
+    uint32_t max_object_age_ms = MAX_OBJECT_AGE_MS;
+    uint32_t force_publish_ms = FORCE_PUBLISH_MS;
+    uint32_t keyframe_ms = KEYFRAME_MS;
+    float delta_range_mm = DELTA_RANGE_EPSILON_MM;
+    float delta_angle_deg = DELTA_ANGLE_EPSILON_DEG;
+    float vehicle_speed_mps = -1.0f;   // Drives the LiDAR motor speed; negative (left out) for the device default
+    float camera_hfov_deg = CAMERA_HFOV_DEG;  // Maps ROI hint angles to image columns
+    uint32_t camera_image_width = CAMERA_IMAGE_WIDTH;
+    bool verbose = VERBOSE_OUTPUT;
+};
+
+RuntimeConfig g_config;              // Main thread at startup, then the correlation thread
+const char* g_config_path = nullptr; // --config file, nullptr when running on defaults
+std::atomic<bool> g_reload_config{false};  // Set by SIGHUP, handled by the correlation thread
+
+// Serialization buffer for OBJECTS messages. ZMQ owns the buffer until it calls
+// releaseObjectsBuffer(), so several are pooled to cover messages still queued.
+struct ObjectsBuffer {
+    string data;
+    std::atomic<bool> in_use{false};
+};
+
+ObjectsBuffer g_objects_buffers[OBJECTS_BUFFER_POOL];
+
+int g_capture_fd = -1;               // --capture log, appended to by both threads
+
+// Where the acquisition loops get nodes from: the LiDAR, or a capture log
+// being replayed
+class ScanSource {
+public:
+    virtual ~ScanSource() {}
+
+    // One full revolution, as ILidarDriver::grabScanDataHq()
+    virtual sl_result grabScan(sl_lidar_response_measurement_node_hq_t* nodes, size_t& count) = 0;
+
+    // Whatever has arrived since the last call, as getScanDataWithIntervalHq()
+    virtual sl_result fetchNodes(sl_lidar_response_measurement_node_hq_t* nodes, size_t& count) = 0;
+
+    // Sort a revolution by angle, as ILidarDriver::ascendScanData()
+    virtual void ascend(sl_lidar_response_measurement_node_hq_t* nodes, size_t count) = 0;
+
+    // Recover from a failed grab; false when acquisition should stop
+    virtual bool restart() = 0;
+
+    // Tear down and recreate the device connection when restarts stop
+    // helping; false while the device is still unreachable
+    virtual bool reconnect() = 0;
+};
+
+// Binary LIDAR frame layout (little-endian, packed). Consumers subscribe to
+// LIDAR_FRAME_MAGIC and can view the point array directly, e.g. with
+// numpy.frombuffer(msg, dtype=[('angle_cdeg', '<i2'), ('dist_mm', '<u2')], offset=24)
+#pragma pack(push, 1)
+struct LidarFrameHeader {
+    char magic[4];             // LIDAR_FRAME_MAGIC, no terminator
+    uint16_t version;          // LIDAR_FRAME_VERSION
+    uint16_t point_count;      // Number of LidarFramePoint entries that follow
+    uint32_t sequence;         // Scan sequence number, wraps at 2^32
+    uint32_t bucket_size_cdeg; // Angle bucket size in hundredths of a degree
+    uint64_t timestamp_ns;     // steady_clock time the scan was processed
+};
+
+struct LidarFramePoint {
+    int16_t angle_cdeg;        // Bucket angle in hundredths of a degree
+    uint16_t dist_mm;          // Closest distance in the bucket
+};
+#pragma pack(pop)
+
+static_assert(sizeof(LidarFrameHeader) == 24, "LidarFrameHeader layout changed");
+static_assert(sizeof(LidarFramePoint) == 4, "LidarFramePoint layout changed");
+
+// Reused between scans so binary publishing does not allocate
+vector<uint8_t> g_frame_buffer;
+
+// Largest binary frame: a full front arc at the finest buckets, or the fused occupancy
+const size_t MAX_LIDAR_FRAME_BYTES =
+    sizeof(LidarFrameHeader) + std::max(MAX_ANGLE_BUCKETS, OCCUPANCY_BINS) * sizeof(LidarFramePoint);
+
+// Shared-memory scan ring for readers on the same machine: a header, then
+// SCAN_SHM_SLOTS slots of slot_size bytes, each holding one binary LIDAR
+// frame. Every slot is a seqlock whose sequence is odd while the frame is
+// being rewritten. A reader takes slot (write_count - 1) % slot_count,
+// copies the frame out and keeps it only if the sequence was even and
+// unchanged across the copy; otherwise it starts again.
+struct ScanShmHeader {
+    char magic[4];             // SCAN_SHM_MAGIC, written last
+    uint16_t version;          // SCAN_SHM_VERSION
+    uint16_t slot_count;       // SCAN_SHM_SLOTS
+    uint32_t slot_size;        // Bytes from one slot to the next
+    uint32_t reserved;
+    std::atomic<uint64_t> write_count;  // Frames written so far
+};
+
+struct ScanShmSlot {
+    std::atomic<uint32_t> sequence;  // Odd while the frame is being written
+    uint32_t frame_size;       // Bytes of frame in use
+    uint8_t frame[(MAX_LIDAR_FRAME_BYTES + 7) / 8 * 8];
+};
+
+static_assert(sizeof(ScanShmHeader) == 24, "ScanShmHeader layout changed");
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "The scan ring needs lock-free atomics to be shared between processes");
+
+ScanShmHeader* g_scan_shm = nullptr;  // Mapped scan ring, nullptr when disabled
+size_t g_scan_shm_size = 0;
+
+ScanShmSlot* scanShmSlots() {
+    return reinterpret_cast<ScanShmSlot*>(g_scan_shm + 1);
+}
+
+// Create (or take over) the scan ring under name and map it
+bool openScanShm(const string& name) {
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        cerr << "Failed to open scan ring " << name << ": " << strerror(errno) << endl;
+        return false;
+    }
+    size_t size = sizeof(ScanShmHeader) + SCAN_SHM_SLOTS * sizeof(ScanShmSlot);
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        cerr << "Failed to map scan ring " << name << ": " << strerror(errno) << endl;
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    close(fd);
+
+    // Readers ignore the ring until the magic shows up
+    memset(map, 0, size);
+    g_scan_shm = static_cast<ScanShmHeader*>(map);
+    g_scan_shm_size = size;
+    g_scan_shm->version = SCAN_SHM_VERSION;
+    g_scan_shm->slot_count = SCAN_SHM_SLOTS;
+    g_scan_shm->slot_size = sizeof(ScanShmSlot);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(g_scan_shm->magic, SCAN_SHM_MAGIC, sizeof(g_scan_shm->magic));
+    return true;
+}
+
+// Copy one binary LIDAR frame into the next ring slot. Single writer: the
+// same thread that publishes LIDAR frames.
+void writeScanShm(const uint8_t* frame, size_t size) {
+    uint64_t count = g_scan_shm->write_count.load(std::memory_order_relaxed);
+    ScanShmSlot& slot = scanShmSlots()[count % SCAN_SHM_SLOTS];
+
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.frame_size = static_cast<uint32_t>(size);
+    memcpy(slot.frame, frame, size);
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+
+    g_scan_shm->write_count.store(count + 1, std::memory_order_release);
+}
+
+// Alert packets go to the tethered ESP32 from their own thread, so a slow,
+// unplugged or wedged serial link never holds up correlation. Only the
+// latest packet waits; an older one still queued is stale and replaced.
+std::mutex g_alert_mutex;
+std::condition_variable g_alert_ready;
+AlertPacket g_pending_alert;         // Guarded by g_alert_mutex
+bool g_alert_pending = false;        // Guarded by g_alert_mutex
+std::thread g_alert_thread;          // Not joinable when alerts are disabled
+
+// Open the alert port raw and non-blocking; -1 on failure
+int openAlertPort(const string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) return -1;
+
+    // Two writers would interleave their bytes into garbled packets, so the
+    // port is held exclusively, as esp32_bridge.py does (pyserial exclusive=True)
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    // Anything but a tty (a FIFO while testing, say) is written as it is
+    termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, ALERT_BAUDRATE);
+        cfsetospeed(&tio, ALERT_BAUDRATE);
+        tio.c_cflag |= CLOCAL;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// Alert writer thread: write each packet handed over by queueAlert(),
+// (re)opening the port as needed. A packet that does not fit in the serial
+// buffer is dropped; the next alert will be more current anyway.
+void alertWriterLoop(string path) {
+    int fd = -1;
+    uint64_t last_open_ms = 0;
+    bool open_failed = false;
+
+    while (true) {
+        AlertPacket packet;
+        bool have_packet;
+        {
+            std::unique_lock<std::mutex> lock(g_alert_mutex);
+            g_alert_ready.wait_for(lock, std::chrono::milliseconds(ALERT_REOPEN_MS),
+                                   [] { return g_alert_pending || !g_running; });
+            if (!g_running) break;
+            have_packet = g_alert_pending;
+            packet = g_pending_alert;
+            g_alert_pending = false;
+        }
+
+        uint64_t now_ms = getMonotonicTimeMs();
+        if (fd < 0 && now_ms - last_open_ms >= ALERT_REOPEN_MS) {
+            last_open_ms = now_ms;
+            fd = openAlertPort(path);
+            if (fd >= 0) {
+                cout << "Alert port " << path << " open" << endl;
+                open_failed = false;
+            } else if (!open_failed) {
+                if (errno == EWOULDBLOCK) {
+                    cerr << "Alert port " << path << " is owned by another process (esp32_bridge.py?), "
+                         << "no alerts are sent until it is released" << endl;
+                } else {
+                    cerr << "Failed to open alert port " << path << ": " << strerror(errno) << ", retrying" << endl;
+                }
+                open_failed = true;
+            }
+        }
+        if (fd < 0 || !have_packet) continue;
+
+        ssize_t written = write(fd, &packet, sizeof(packet));
+        uint32_t event = static_cast<uint32_t>(packet.urgency) << 16 | packet.sequence;
+        if (written == sizeof(packet)) {
+            recordEvent(EVENT_ALERT_SENT, packet.class_id, event);
+            continue;
+        }
+        recordEvent(EVENT_ALERT_DROPPED, packet.class_id, event);
+        if (written >= 0 || errno == EAGAIN) {
+            if (g_verbose) cerr << "Alert port busy, dropped an alert" << endl;
+        } else {
+            cerr << "Failed to write alert to " << path << ": " << strerror(errno) << endl;
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd >= 0) close(fd);
+}
+
+// Hand an alert to the writer thread. Never waits on the serial port.
+void queueAlert(const AlertPacket& packet) {
+    {
+        std::lock_guard<std::mutex> lock(g_alert_mutex);
+        g_pending_alert = packet;
+        g_alert_pending = true;
+    }
+    g_alert_ready.notify_one();
+}
+
+// Correlation thread: alert about the most urgent fused object. A track
+// alerts again only after ALERT_REPEAT_MS, unless it got more urgent or
+// another track took over, and never more often than ALERT_MIN_INTERVAL_MS.
+void emitAlerts(uint64_t now_ms) {
+    static uint64_t last_sent_ms = 0;
+    static uint32_t last_track_id = 0;
+    static uint8_t last_urgency = 0;
+    static uint16_t sequence = 0;
+
+    if (!g_alert_thread.joinable()) return;
+
+    uint8_t urgency;
+    int index = selectAlertObject(&urgency);
+    if (index < 0) return;
+
+    const DetectedObject& obj = g_objects[index];
+    uint64_t since_ms = now_ms - last_sent_ms;
+    if (since_ms < ALERT_MIN_INTERVAL_MS) return;
+    bool escalated = obj.track_id != last_track_id || urgency >= last_urgency + ALERT_URGENCY_STEP;
+    if (!escalated && since_ms < ALERT_REPEAT_MS) return;
+
+    queueAlert(makeAlertPacket(obj, urgency, ++sequence));
+    last_sent_ms = now_ms;
+    last_track_id = obj.track_id;
+    last_urgency = urgency;
+}
+
+void stopAlertWriter() {
+    if (!g_alert_thread.joinable()) return;
+    g_running = false;
+    {
+        std::lock_guard<std::mutex> lock(g_alert_mutex);
+    }
+    g_alert_ready.notify_all();
+    g_alert_thread.join();
+}
+
+// Buckets per streaming sector
+int streamSectorBuckets(const ScanGeometry& geometry) {
+    return std::max(1, static_cast<int>(STREAM_SECTOR_DEG / geometry.bucket_size_deg));
+}
+
+// Streaming state: the front arc as of the latest nodes. Bins are reset when
+// the sweep enters them, so each one always holds its most recent pass.
+// Clusters closed during this pass are kept in sweep order (descending
+// angle) next to the previous pass's, which still cover the part of the arc
+// not yet swept again.
+struct SweepState {
+    ScanBins live;             // generation is fixed at 1; a bin is live when its generation is 1
+    int current_bucket = -1;   // Bucket the sweep is in, -1 while outside the front arc
+    int buckets_since_publish = 0;
+    ClusterBuilder builder;
+    float last_angle = FRONT_ARC_DEG;  // Lowest angle reached in this pass
+    ScanCluster pass_clusters[MAX_SCAN_CLUSTERS];
+    int pass_count = 0;
+    ScanCluster prev_clusters[MAX_SCAN_CLUSTERS];
+    int prev_count = 0;
+};
+
+// One range sensor and its acquisition thread: the device (or a replayed
+// log), the scan binning, and the hand-off of completed scans to the
+// fusion stage on the correlation thread. Each instance owns everything it
+// touches, so sensors run side by side on their own cores.
+class SensorPipeline {
+public:
+    SensorPipeline(int index, const SensorConfig& config);
+    ~SensorPipeline();
+
+    // Bring up the LiDAR on config.serial_port; false on failure
+    bool open();
+
+    // Read from source instead, e.g. a replayed log. Takes ownership.
+    void setSource(ScanSource* source);
+
+    void start();
+    void join();
+
+    // Connect to the LiDAR, check its health and start scanning. Returns
+    // the driver, or nullptr on failure; also used to reconnect.
+    ILidarDriver* initLidar();
+
+    // Stop and release the LiDAR connection
+    void releaseLidar();
+
+    // Acquisition thread: follow g_vehicle_speed_mps with the motor speed
+    void adjustMotorSpeed();
+
+    const int index;
+    const SensorConfig config;
+    bool publish_lidar = true;     // Publish this sensor's scans as LIDAR frames
+    bool capture = false;          // Write this sensor's nodes to the --capture log
+    bool deskew = true;            // Undo the vehicle's motion per revolution; off for a replay
+
+    TripleBuffer<ScanBins> scans;  // Completed scans, read by the correlation thread
+    TripleBuffer<ScanGeometry> geometry_updates;  // Reloaded geometry, read by the acquisition thread
+    LidarScanMode scan_mode = {};  // Chosen by initLidar(), reused on restarts
+
+private:
+    bool applyGeometryUpdate();
+    void setDegraded(bool degraded);
+    bool recoverSource();
+    void publishScan();
+    void acquisitionLoop();
+    void publishSweep(float cutoff_deg);
+    void processStreamNode(const sl_lidar_response_measurement_node_hq_t& node, uint64_t capture_ns);
+    void streamingAcquisitionLoop();
+    ILidarDriver* abortLidarInit(const char* message);
+    bool startScanning(ILidarDriver* lidar);
+
+    ScanSource* source = nullptr;
+    ILidarDriver* drv = nullptr;
+    IChannel* channel = nullptr;
+    ScanContext context;
+    SweepState sweep;
+    bool degraded = false;
+    uint64_t degraded_since_ms = 0;
+    LidarMotorInfo motor = {};     // motorCtrlSupport is MotorCtrlSupportNone when the speed is fixed
+    sl_u16 motor_speed = DEFAULT_MOTOR_SPEED;  // Last speed set
+    sl_lidar_response_measurement_node_hq_t nodes[MAX_SCAN_NODES];
+    std::thread thread;
+};
+
+vector<SensorPipeline*> g_pipelines; // Fixed once the acquisition threads start; [0] is correlated with the camera
+
+// All-round view fused from every sensor. Correlation thread only.
+PolarOccupancy g_occupancy;
+
+void cleanup() {
+    if (g_verbose) {
+        cout << "\nCleaning up..." << endl;
+    }
+    
+    // Stop the LiDARs and close their serial channels
+    for (SensorPipeline* pipeline : g_pipelines) {
+        pipeline->releaseLidar();
+    }
+
+    if (g_alert_thread.joinable()) {
+        if (g_verbose) cout << "Stopping alert writer..." << endl;
+        stopAlertWriter();
+    }
+    
+    // Close ZMQ sockets
+    if (g_publisher) {
+        if (g_verbose) cout << "Closing ZMQ publisher..." << endl;
+        g_publisher->close();
+        delete g_publisher;
+        g_publisher = nullptr;
+    }
+    if (g_subscriber) {
+        if (g_verbose) cout << "Closing ZMQ subscriber..." << endl;
+        g_subscriber->close();
+        delete g_subscriber;
+        g_subscriber = nullptr;
+    }
+    if (g_corr_publisher) {
+        if (g_verbose) cout << "Closing ZMQ correlation publisher..." << endl;
+        g_corr_publisher->close();
+        delete g_corr_publisher;
+        g_corr_publisher = nullptr;
+    }
+    if (g_stats_publisher) {
+        if (g_verbose) cout << "Closing ZMQ stats publisher..." << endl;
+        g_stats_publisher->close();
+        delete g_stats_publisher;
+        g_stats_publisher = nullptr;
+    }
+    if (g_imu_subscriber) {
+        if (g_verbose) cout << "Closing ZMQ IMU subscriber..." << endl;
+        g_imu_subscriber->close();
+        delete g_imu_subscriber;
+        g_imu_subscriber = nullptr;
+    }
+    if (g_roi_publisher) {
+        if (g_verbose) cout << "Closing ZMQ ROI hint publisher..." << endl;
+        g_roi_publisher->close();
+        delete g_roi_publisher;
+        g_roi_publisher = nullptr;
+    }
+
+    // Replay owns a socket, so sources go before the context
+    for (SensorPipeline* pipeline : g_pipelines) {
+        delete pipeline;
+    }
+    g_pipelines.clear();
+
+    if (g_scan_shm) {
+        if (g_verbose) cout << "Removing scan ring " << g_config.scan_shm << "..." << endl;
+        munmap(g_scan_shm, g_scan_shm_size);
+        shm_unlink(g_config.scan_shm.c_str());
+        g_scan_shm = nullptr;
+    }
+
+    if (g_capture_fd >= 0) {
+        if (g_verbose) cout << "Closing capture file..." << endl;
+        close(g_capture_fd);
+        g_capture_fd = -1;
+    }
+    
+    // Close ZMQ context
+    if (g_context) {
+        if (g_verbose) cout << "Closing ZMQ context..." << endl;
+        g_context->close();
+        delete g_context;
+        g_context = nullptr;
+    }
+    
+    if (g_verbose) cout << "Cleanup complete." << endl;
+}
+
+void toggleLidarPublishing() {
+    g_publish_lidar_data = !g_publish_lidar_data.load();
+    cout << "LIDAR data publishing " << (g_publish_lidar_data ? "enabled" : "disabled") << endl;
+}
+
+// Write the flight recorder to g_flight_recorder_path, oldest event first.
+// Only open/write/close, so a crash handler can call it. False on failure.
+bool dumpFlightRecorder() {
+    if (g_flight_recorder_path[0] == '\0') return false;
+    int fd = open(g_flight_recorder_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    uint64_t end = g_flight_recorder.count.load(std::memory_order_acquire);
+    uint64_t begin = end > FLIGHT_RECORDER_EVENTS ? end - FLIGHT_RECORDER_EVENTS : 0;
+
+    // Events being rewritten are skipped, so the count is patched in after
+    FlightFileHeader header = {};
+    memcpy(header.magic, FLIGHT_FILE_MAGIC, sizeof(header.magic));
+    header.version = FLIGHT_FILE_VERSION;
+    header.event_size = sizeof(FlightEvent);
+    header.lost = static_cast<uint32_t>(begin);
+    header.dumped_ns = getMonotonicTimeNs();
+    header.dumped_us = getCurrentTimeUs();
+    bool ok = write(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header));
+
+    FlightEvent batch[256];
+    size_t batched = 0;
+    for (uint64_t n = begin; ok && n < end; n++) {
+        if (readFlightEvent(n, batch[batched])) {
+            batched++;
+            header.count++;
+        }
+        if (batched == sizeof(batch) / sizeof(batch[0]) || (n + 1 == end && batched > 0)) {
+            ssize_t size = static_cast<ssize_t>(batched * sizeof(FlightEvent));
+            ok = write(fd, batch, size) == size;
+            batched = 0;
+        }
+    }
+    ok = ok && pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    close(fd);
+    return ok;
+}
+
+// Fatal signals: leave the flight recorder behind, then die as we would have
+void crashHandler(int signum) {
+    dumpFlightRecorder();
+    signal(signum, SIG_DFL);
+    raise(signum);
+}
+
+void signalHandler(int signum) {
+    if (signum == SIGUSR1) {
+        toggleLidarPublishing();
+        return;
+    }
+    if (signum == SIGUSR2) {
+        g_dump_flight_recorder = true;
+        return;
+    }
+    if (signum == SIGHUP) {
+        g_reload_config = true;
+        return;
+    }
+    
+    cout << "\nReceived signal " << signum << ", initiating cleanup..." << endl;
+    g_running = false;
+}
+
+// Read one optional key into out; false (with a message) when it has the wrong type
+bool readConfigString(const Json::Value& root, const char* key, string& out) {
+    if (!root.isMember(key)) return true;
+    const Json::Value& value = root[key];
+    if (value.isString()) {
+        out = value.asString();
+    } else if (value.isUInt()) {
+        out = to_string(value.asUInt());  // Ports may be written as numbers
+    } else {
+        cerr << "Config: " << key << " must be a string" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Endpoint for a zmq_port_* setting: a full endpoint as given (ipc://,
+// tcp://, ...), or a bare port as TCP on host
+string zmqEndpoint(const string& port, const char* host) {
+    if (port.find("://") != string::npos) {
+        return port;
+    }
+    return string("tcp://") + host + ":" + port;
+}
+
+bool readConfigUInt(const Json::Value& root, const char* key, uint32_t& out) {
+    if (!root.isMember(key)) return true;
+    if (!root[key].isUInt() || root[key].asUInt() == 0) {
+        cerr << "Config: " << key << " must be a positive integer" << endl;
+        return false;
+    }
+    out = root[key].asUInt();
+    return true;
+}
+
+bool readConfigFloat(const Json::Value& root, const char* key, float& out) {
+    if (!root.isMember(key)) return true;
+    if (!root[key].isNumeric() || root[key].asDouble() < 0.0) {
+        cerr << "Config: " << key << " must be a non-negative number" << endl;
+        return false;
+    }
+    out = root[key].asFloat();
+    return true;
+}
+
+// Fill config.sensors from the optional "sensors" list, e.g.
+//   "sensors": [{"serial_port": "/dev/ttyUSB0"},
+//               {"serial_port": "/dev/ttyUSB1", "mount_yaw_deg": 180}]
+// Without it, one forward-facing LiDAR on serial_port is used.
+bool loadSensorConfigs(const Json::Value& root, RuntimeConfig& config) {
+    config.sensors.clear();
+    if (!root.isMember("sensors")) {
+        SensorConfig sensor;
+        sensor.serial_port = config.serial_port;
+        sensor.serial_baudrate = config.serial_baudrate;
+        config.sensors.push_back(sensor);
+        return true;
+    }
+
+    const Json::Value& sensors = root["sensors"];
+    if (!sensors.isArray() || sensors.empty() || sensors.size() > MAX_SENSORS) {
+        cerr << "Config: sensors must be a list of 1 to " << MAX_SENSORS << " sensors" << endl;
+        return false;
+    }
+    for (const Json::Value& entry : sensors) {
+        SensorConfig sensor;
+        sensor.serial_baudrate = config.serial_baudrate;
+        uint32_t baudrate = sensor.serial_baudrate;
+        if (!entry.isObject()) {
+            cerr << "Config: each entry of sensors must be an object" << endl;
+            return false;
+        }
+        if (!readConfigString(entry, "serial_port", sensor.serial_port) ||
+            !readConfigUInt(entry, "serial_baudrate", baudrate)) {
+            return false;
+        }
+        sensor.serial_baudrate = static_cast<int>(baudrate);
+
+        const Json::Value& yaw = entry.get("mount_yaw_deg", 0.0);
+        const Json::Value& stream = entry.get("stream_scan", false);
+        if (!yaw.isNumeric() || !stream.isBool()) {
+            cerr << "Config: mount_yaw_deg must be a number and stream_scan true or false" << endl;
+            return false;
+        }
+        sensor.mount_yaw_deg = yaw.asFloat();
+        sensor.stream_scan = stream.asBool();
+        config.sensors.push_back(sensor);
+    }
+    return true;
+}
+
+bool sameSensors(const vector<SensorConfig>& a, const vector<SensorConfig>& b) {
+    return a.size() == b.size() &&
+        std::equal(a.begin(), a.end(), b.begin(), [](const SensorConfig& x, const SensorConfig& y) {
+            return x.serial_port == y.serial_port && x.serial_baudrate == y.serial_baudrate &&
+                   x.mount_yaw_deg == y.mount_yaw_deg && x.stream_scan == y.stream_scan;
+        });
+}
+
+// Clear the outputs g_profile leaves out, reporting any a config file set if complain
+void disableProfileOutputs(RuntimeConfig& config, bool complain) {
+    struct { bool enabled; const char* key; string& value; } outputs[] = {
+        { g_profile.alerts, "alert_port", config.alert_port },
+        { g_profile.stats, "zmq_port_stats", config.zmq_port_stats },
+        { g_profile.imu, "zmq_port_imu", config.zmq_port_imu },
+        { g_profile.roi, "zmq_port_roi", config.zmq_port_roi },
+        { g_profile.flight_recorder, "flight_recorder_path", config.flight_recorder_path }
+    };
+    for (auto& output : outputs) {
+        if (output.enabled || output.value.empty()) continue;
+        if (complain) cerr << "Config: ignoring " << output.key << ", this build has no such output" << endl;
+        output.value.clear();
+    }
+}
+
+// What this build runs with before any --config file: the compile-time
+// defaults, the profile's bucket size and none of the outputs it leaves out
+RuntimeConfig profileConfig() {
+    RuntimeConfig config;
+    makeScanGeometry(g_profile.bucket_size_deg, MAX_DISTANCE_MM, config.geometry);
+    disableProfileOutputs(config, false);
+    return config;
+}
+
+// Parse and validate a config file on top of this build's defaults, see
+// profileConfig(). Returns false, leaving out untouched, if the file is
+// unreadable or invalid.
+bool loadConfig(const char* path, RuntimeConfig& out) {
+    ifstream file(path);
+    if (!file) {
+        cerr << "Failed to open config file " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    Json::CharReaderBuilder builder;
+    Json::Value root;
+    string errors;
+    if (!Json::parseFromStream(builder, file, &root, &errors) || !root.isObject()) {
+        cerr << "Failed to parse config file " << path << ": " << errors << endl;
+        return false;
+    }
+
+    static const char* const KNOWN_KEYS[] = {
+        "serial_port", "serial_baudrate", "zmq_port_pub", "zmq_port_sub", "zmq_port_obj",
+        "zmq_port_stats", "angle_bucket_size_deg", "max_distance_mm", "max_object_age_ms",
+        "force_publish_ms", "keyframe_ms", "delta_range_mm", "delta_angle_deg", "verbose", "sensors",
+        "scan_shm", "alert_port", "vehicle_speed_mps", "zmq_port_imu", "zmq_port_roi", "camera_hfov_deg",
+        "camera_image_width", "flight_recorder_path"
+    };
+    for (const string& key : root.getMemberNames()) {
+        if (std::find(std::begin(KNOWN_KEYS), std::end(KNOWN_KEYS), key) == std::end(KNOWN_KEYS)) {
+            cerr << "Config: ignoring unknown key " << key << endl;
+        }
+    }
+
+    RuntimeConfig config = profileConfig();
+    uint32_t baudrate = config.serial_baudrate;
+    bool ok = readConfigString(root, "serial_port", config.serial_port) &&
+              readConfigUInt(root, "serial_baudrate", baudrate) &&
+              readConfigString(root, "zmq_port_pub", config.zmq_port_pub) &&
+              readConfigString(root, "zmq_port_sub", config.zmq_port_sub) &&
+              readConfigString(root, "zmq_port_obj", config.zmq_port_obj) &&
+              readConfigString(root, "zmq_port_stats", config.zmq_port_stats) &&
+              readConfigString(root, "zmq_port_imu", config.zmq_port_imu) &&
+              readConfigString(root, "zmq_port_roi", config.zmq_port_roi) &&
+              readConfigString(root, "scan_shm", config.scan_shm) &&
+              readConfigString(root, "alert_port", config.alert_port) &&
+              readConfigString(root, "flight_recorder_path", config.flight_recorder_path) &&
+              readConfigUInt(root, "max_object_age_ms", config.max_object_age_ms) &&
+              readConfigUInt(root, "force_publish_ms", config.force_publish_ms) &&
+              readConfigUInt(root, "keyframe_ms", config.keyframe_ms) &&
+              readConfigFloat(root, "delta_range_mm", config.delta_range_mm) &&
+              readConfigFloat(root, "delta_angle_deg", config.delta_angle_deg) &&
+              readConfigFloat(root, "vehicle_speed_mps", config.vehicle_speed_mps) &&
+              readConfigFloat(root, "camera_hfov_deg", config.camera_hfov_deg) &&
+              readConfigUInt(root, "camera_image_width", config.camera_image_width);
+    if (!ok) return false;
+    config.serial_baudrate = static_cast<int>(baudrate);
+    disableProfileOutputs(config, true);
+
+    if (config.flight_recorder_path.size() >= sizeof(g_flight_recorder_path)) {
+        cerr << "Config: flight_recorder_path must be shorter than " << sizeof(g_flight_recorder_path) << " characters" << endl;
+        return false;
+    }
+
+    // readConfigUInt() has already turned down a zero camera_image_width
+    if (!(config.camera_hfov_deg > 0.0f && config.camera_hfov_deg < 180.0f) || config.camera_image_width > 65536) {
+        cerr << "Config: camera_hfov_deg must be in (0, 180) and camera_image_width at most 65536" << endl;
+        return false;
+    }
+
+    if (root.isMember("verbose")) {
+        if (!root["verbose"].isBool()) {
+            cerr << "Config: verbose must be true or false" << endl;
+            return false;
+        }
+        config.verbose = root["verbose"].asBool();
+    }
+
+    if (!loadSensorConfigs(root, config)) return false;
+
+    const Json::Value& bucketSize = root.get("angle_bucket_size_deg", config.geometry.bucket_size_deg);
+    const Json::Value& maxDistance = root.get("max_distance_mm", MAX_DISTANCE_MM);
+    if (!bucketSize.isNumeric() || !maxDistance.isNumeric() ||
+        !makeScanGeometry(bucketSize.asDouble(), maxDistance.asDouble(), config.geometry)) {
+        cerr << "Config: angle_bucket_size_deg must be at least " << MIN_ANGLE_BUCKET_SIZE
+             << " and divide " << FRONT_ARC_DEG << ", max_distance_mm must be in ("
+             << MIN_DISTANCE_MM << ", " << MAX_DISTANCE_LIMIT_MM << "]" << endl;
+        return false;
+    }
+
+    out = config;
+    return true;
+}
+
+// Make config the live configuration. The tunables take effect immediately;
+// the acquisition thread picks up the geometry at its next scan.
+void applyConfig(const RuntimeConfig& config) {
+    g_verbose = config.verbose;
+    g_max_object_age_ms = config.max_object_age_ms;
+    g_force_publish_ms = config.force_publish_ms;
+    g_keyframe_ms = config.keyframe_ms;
+    g_delta_range_mm = config.delta_range_mm;
+    g_delta_angle_deg = config.delta_angle_deg;
+    g_vehicle_speed_mps = config.vehicle_speed_mps;
+
+    uint32_t version = g_config.geometry.version + 1;
+    for (SensorPipeline* pipeline : g_pipelines) {
+        ScanGeometry& geometry = pipeline->geometry_updates.back();
+        geometry = config.geometry;
+        geometry.version = version;
+        pipeline->geometry_updates.publish();
+    }
+
+    g_config = config;
+    g_config.geometry.version = version;
+}
+
+// Correlation thread: re-read the config file after SIGHUP
+void reloadConfig() {
+    if (!g_config_path) {
+        cerr << "No --config file to reload" << endl;
+        return;
+    }
+
+    RuntimeConfig config;
+    if (!loadConfig(g_config_path, config)) {
+        cerr << "Keeping the current configuration" << endl;
+        return;
+    }
+
+    // Sockets and the serial link stay as they were opened
+    if (config.serial_port != g_config.serial_port || config.serial_baudrate != g_config.serial_baudrate ||
+        config.zmq_port_pub != g_config.zmq_port_pub || config.zmq_port_sub != g_config.zmq_port_sub ||
+        config.zmq_port_obj != g_config.zmq_port_obj || config.zmq_port_stats != g_config.zmq_port_stats ||
+        config.zmq_port_imu != g_config.zmq_port_imu || config.zmq_port_roi != g_config.zmq_port_roi ||
+        config.scan_shm != g_config.scan_shm || config.alert_port != g_config.alert_port ||
+        config.flight_recorder_path != g_config.flight_recorder_path ||
+        !sameSensors(config.sensors, g_config.sensors)) {
+        cerr << "Serial, sensor, ZMQ endpoint, scan ring, alert port and flight recorder changes take effect on restart"
+             << endl;
+        config.scan_shm = g_config.scan_shm;
+        config.alert_port = g_config.alert_port;
+        config.flight_recorder_path = g_config.flight_recorder_path;
+        config.sensors = g_config.sensors;
+        config.serial_port = g_config.serial_port;
+        config.serial_baudrate = g_config.serial_baudrate;
+        config.zmq_port_pub = g_config.zmq_port_pub;
+        config.zmq_port_sub = g_config.zmq_port_sub;
+        config.zmq_port_obj = g_config.zmq_port_obj;
+        config.zmq_port_stats = g_config.zmq_port_stats;
+        config.zmq_port_imu = g_config.zmq_port_imu;
+        config.zmq_port_roi = g_config.zmq_port_roi;
+    }
+
+    applyConfig(config);
+    cout << "Reloaded " << g_config_path << ": " << config.geometry.bucket_size_deg << " deg buckets, "
+         << config.geometry.max_distance_mm << " mm range" << endl;
+}
+
+// Open the capture log for writing and write its header
+bool openCapture(const char* path) {
+    g_capture_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (g_capture_fd < 0) {
+        cerr << "Failed to open capture file " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    CaptureFileHeader header = {};
+    memcpy(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_FILE_VERSION;
+    header.node_size = sizeof(sl_lidar_response_measurement_node_hq_t);
+    if (write(g_capture_fd, &header, sizeof(header)) != sizeof(header)) {
+        cerr << "Failed to write capture header: " << strerror(errno) << endl;
+        close(g_capture_fd);
+        g_capture_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+// Append one record when capturing. Each record goes out in a single
+// writev() on an O_APPEND descriptor, so records from the acquisition and
+// correlation threads never interleave.
+void captureRecord(CaptureRecordType type, const void* data, size_t size) {
+    if (g_capture_fd < 0) return;
+
+    static const uint8_t padding[8] = {};
+    CaptureRecordHeader header = {};
+    header.type = type;
+    header.size = static_cast<uint32_t>(size);
+    header.timestamp_ns = getMonotonicTimeNs();
+
+    iovec parts[3] = {
+        { &header, sizeof(header) },
+        { const_cast<void*>(data), size },
+        { const_cast<uint8_t*>(padding), (8 - size % 8) % 8 }
+    };
+    if (writev(g_capture_fd, parts, 3) < 0 && g_verbose) {
+        cerr << "Failed to write capture record: " << strerror(errno) << endl;
+    }
+}
+
+// Called by ZMQ (possibly from its I/O thread) once an OBJECTS buffer is sent
+void releaseObjectsBuffer(void* /*data*/, void* hint) {
+    static_cast<ObjectsBuffer*>(hint)->in_use.store(false, std::memory_order_release);
+}
+
+// Claim a free OBJECTS buffer, or nullptr if all of them are still inside ZMQ
+ObjectsBuffer* acquireObjectsBuffer() {
+    for (ObjectsBuffer& buffer : g_objects_buffers) {
+        bool expected = false;
+        if (buffer.in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+// Force publish current objects even if unchanged. With --objects-delta only
+// changes go out, as OBJECTS_DELTA, and a full OBJECTS keyframe every
+// keyframe_ms lets late joiners (and anyone who missed a sequence) catch up.
+void publishObjects(bool force = false) {
+    uint64_t now_ms = getMonotonicTimeMs();
+    
+    // Check if we need to force publish based on timer
+    bool should_publish = force || 
+                         (now_ms - g_last_obj_publish_time >= g_force_publish_ms.load(std::memory_order_relaxed));
+    if (!should_publish) {
+        return;
+    }
+
+    // With no objects, still publish while degraded and once on recovery so
+    // consumers see the sensor status. Keyframes also serve as a heartbeat.
+    static bool last_degraded = false;
+    bool degraded = g_degraded_sensors.load(std::memory_order_relaxed) > 0;
+    bool status_changed = degraded != last_degraded;
+    bool keyframe = !g_objects_delta || now_ms - g_last_keyframe_time >= g_keyframe_ms.load(std::memory_order_relaxed);
+    if (!g_objects_delta && g_object_count == 0 && !degraded && !last_degraded) {
+        return;
+    }
+
+    // Message timestamps stay wall-clock so subscribers can measure latency
+    ObjectsMessageInfo info = { getCurrentTimeMs(), now_ms, g_objects_sequence + 1, force, degraded };
+    uint64_t start_ns = getMonotonicTimeNs();
+
+    // Serialize into a pooled buffer that ZMQ sends without copying; if
+    // every one is still queued, fall back to a copy
+    static string overflow;
+    ObjectsBuffer* buffer = acquireObjectsBuffer();
+    string& out = buffer ? buffer->data : overflow;
+    if (keyframe) {
+        writeObjectsMessage(out, info);
+        g_last_keyframe_time = now_ms;
+    } else if (writeObjectsDelta(out, info, g_delta_range_mm.load(std::memory_order_relaxed),
+                                 g_delta_angle_deg.load(std::memory_order_relaxed)) == 0 && !status_changed) {
+        if (buffer) releaseObjectsBuffer(nullptr, buffer);
+        return;  // Nothing moved enough to be worth a message
+    }
+    last_degraded = degraded;
+    g_last_obj_publish_time = now_ms;
+    g_objects_sequence++;
+    recordEvent(EVENT_PUBLISH_OBJECTS, 0, static_cast<uint32_t>(g_object_count));
+
+    try {
+        if (buffer) {
+            zmq::message_t message(&out[0], out.size(), releaseObjectsBuffer, buffer);
+            g_corr_publisher->send(message, zmq::send_flags::dontwait);
+        } else {
+            zmq::message_t message(out.data(), out.size());
+            g_corr_publisher->send(message, zmq::send_flags::dontwait);
+        }
+        
+        if (g_verbose && force) {
+            std::cout << "Forced publish of " << g_object_count << " objects" << std::endl;
+        }
+    } catch (const zmq::error_t&) {}
+    recordStage(STAGE_PUBLISH_OBJECTS, start_ns);
+}
+
+// Publish per-stage counts and p50/p99/max latency for the last interval.
+// Histograms are cumulative; the previous snapshot is kept here and diffed.
+void publishStats(uint64_t interval_ms) {
+    static uint32_t previous[NUM_STAGES][HISTOGRAM_BUCKETS];
+    static string out;
+
+    out.clear();
+    out += "{\"interval_ms\":";
+    appendJsonUInt64(out, interval_ms);
+    out += ",\"stages\":{";
+
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        LatencyHistogram& h = g_stage_histograms[stage];
+        uint32_t delta[HISTOGRAM_BUCKETS];
+        uint64_t total = 0;
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            uint32_t now = h.counts[b].load(std::memory_order_relaxed);
+            delta[b] = now - previous[stage][b];
+            previous[stage][b] = now;
+            total += delta[b];
+        }
+        uint64_t max_ns = h.max_ns.exchange(0, std::memory_order_relaxed);
+
+        // Percentiles are the midpoints of the buckets holding those ranks
+        uint64_t p50 = 0, p99 = 0, seen = 0;
+        uint64_t rank50 = (total * 50 + 99) / 100, rank99 = (total * 99 + 99) / 100;
+        for (int b = 0; b < HISTOGRAM_BUCKETS && seen < rank99; b++) {
+            seen += delta[b];
+            if (p50 == 0 && seen >= rank50) p50 = histogramBucketValue(b);
+            if (seen >= rank99) p99 = histogramBucketValue(b);
+        }
+
+        char buf[160];
+        int len = snprintf(buf, sizeof(buf),
+                           "%s\"%s\":{\"count\":%llu,\"max_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f}",
+                           stage ? "," : "", STAGE_NAMES[stage], static_cast<unsigned long long>(total),
+                           max_ns / 1000.0, std::min(p50, max_ns) / 1000.0, std::min(p99, max_ns) / 1000.0);
+        out.append(buf, len);
+    }
+
+    out += "},\"timestamp\":";
+    appendJsonUInt64(out, getCurrentTimeMs());
+    out += ",\"type\":\"STATS\"}";
+
+    if (g_verbose) cout << out << endl;
+
+    try {
+        zmq::message_t message(out.data(), out.size());
+        g_stats_publisher->send(message, zmq::send_flags::dontwait);
+    } catch (const zmq::error_t&) {}
+}
+
+// Send downsampled points as a text LIDAR_DATA message ("angle,dist;...")
+void publishLidarText(const ScanBins& scan) {
+    stringstream ss;
+    ss << "LIDAR_DATA ";
+    
+    // Send all points immediately without batching
+    for (int i = 0; i < scan.geometry.num_buckets; i++) {
+        if (isBinValid(scan, i)) {
+            ss << bucketIndexToAngle(scan.geometry, i) << "," << scan.bins[i].distance_mm << ";";
+        }
+    }
+    
+    string msg = ss.str();
+    zmq::message_t message(msg.size());
+    memcpy(message.data(), msg.c_str(), msg.size());
+    g_publisher->send(message, zmq::send_flags::dontwait);
+}
+
+// Send the binary frame in g_frame_buffer to the scan ring and, with
+// --binary-lidar, over ZMQ
+void publishLidarFrame(size_t frameSize) {
+    if (g_scan_shm) {
+        writeScanShm(g_frame_buffer.data(), frameSize);
+    }
+    if (g_binary_lidar_frames) {
+        zmq::message_t message(g_frame_buffer.data(), frameSize);
+        g_publisher->send(message, zmq::send_flags::dontwait);
+    }
+}
+
+// Pack downsampled points into g_frame_buffer as a binary frame (see
+// LidarFrameHeader). Returns the frame size.
+size_t buildLidarFrame(const ScanBins& scan) {
+    size_t frameSize = sizeof(LidarFrameHeader) + scan.valid_count * sizeof(LidarFramePoint);
+    g_frame_buffer.resize(frameSize);
+
+    LidarFrameHeader header;
+    memcpy(header.magic, LIDAR_FRAME_MAGIC, sizeof(header.magic));
+    header.version = LIDAR_FRAME_VERSION;
+    header.point_count = static_cast<uint16_t>(scan.valid_count);
+    header.sequence = g_scan_sequence;
+    header.bucket_size_cdeg = static_cast<uint32_t>(lroundf(scan.geometry.bucket_size_deg * 100.0f));
+    header.timestamp_ns = scan.completed_ns;
+    memcpy(g_frame_buffer.data(), &header, sizeof(header));
+
+    LidarFramePoint* out = reinterpret_cast<LidarFramePoint*>(g_frame_buffer.data() + sizeof(header));
+    for (int i = 0; i < scan.geometry.num_buckets; i++) {
+        if (isBinValid(scan, i)) {
+            out->angle_cdeg = static_cast<int16_t>(lroundf(bucketIndexToAngle(scan.geometry, i) * 100.0f));
+            out->dist_mm = static_cast<uint16_t>(lroundf(scan.bins[i].distance_mm));
+            out++;
+        }
+    }
+    return frameSize;
+}
+
+// Send the fused occupancy as a text LIDAR_DATA message, -180 to 180 degrees
+void publishOccupancyText(const PolarOccupancy& grid) {
+    stringstream ss;
+    ss << "LIDAR_DATA ";
+    for (int k = 1; k <= OCCUPANCY_BINS; k++) {
+        int i = (OCCUPANCY_BINS / 2 + k) % OCCUPANCY_BINS;
+        if (grid.cells[i].sensor != OCCUPANCY_NO_SENSOR) {
+            ss << occupancyAngle(i) << "," << grid.cells[i].range_mm << ";";
+        }
+    }
+
+    string msg = ss.str();
+    zmq::message_t message(msg.size());
+    memcpy(message.data(), msg.c_str(), msg.size());
+    g_publisher->send(message, zmq::send_flags::dontwait);
+}
+
+// Pack the fused occupancy into g_frame_buffer as a binary frame, -180 to
+// 180 degrees. Returns the frame size.
+size_t buildOccupancyFrame(const PolarOccupancy& grid) {
+    g_frame_buffer.resize(sizeof(LidarFrameHeader) + OCCUPANCY_BINS * sizeof(LidarFramePoint));
+    LidarFramePoint* out = reinterpret_cast<LidarFramePoint*>(g_frame_buffer.data() + sizeof(LidarFrameHeader));
+    uint16_t count = 0;
+    for (int k = 1; k <= OCCUPANCY_BINS; k++) {
+        int i = (OCCUPANCY_BINS / 2 + k) % OCCUPANCY_BINS;
+        if (grid.cells[i].sensor != OCCUPANCY_NO_SENSOR) {
+            out[count].angle_cdeg = static_cast<int16_t>(lroundf(occupancyAngle(i) * 100.0f));
+            out[count].dist_mm = static_cast<uint16_t>(lroundf(grid.cells[i].range_mm));
+            count++;
+        }
+    }
+
+    LidarFrameHeader header;
+    memcpy(header.magic, LIDAR_FRAME_MAGIC, sizeof(header.magic));
+    header.version = LIDAR_FRAME_VERSION;
+    header.point_count = count;
+    header.sequence = g_scan_sequence;
+    header.bucket_size_cdeg = static_cast<uint32_t>(lround(OCCUPANCY_BIN_DEG * 100.0));
+    header.timestamp_ns = grid.fused_ns;
+    memcpy(g_frame_buffer.data(), &header, sizeof(header));
+    return sizeof(header) + count * sizeof(LidarFramePoint);
+}
+
+// Update the all-round occupancy whenever any sensor completed a scan.
+// Sensors whose latest scan is stale add nothing; what they saw last fades
+// out with the grid's decay. Correlation falls back to the grid when a
+// detection has no cluster, and with several sensors the fused view is what
+// goes out as LIDAR frames.
+void fuseSensors() {
+    static uint32_t fused_generation[MAX_SENSORS];
+
+    const ScanBins* scans[MAX_SENSORS];
+    bool changed = false;
+    for (SensorPipeline* pipeline : g_pipelines) {
+        const ScanBins& scan = pipeline->scans.read();
+        scans[pipeline->index] = &scan;
+        if (scan.generation != fused_generation[pipeline->index]) {
+            fused_generation[pipeline->index] = scan.generation;
+            changed = true;
+        }
+    }
+    if (!changed) {
+        return;
+    }
+
+    uint64_t start_ns = getMonotonicTimeNs();
+    beginOccupancyUpdate(g_occupancy, start_ns);
+    for (SensorPipeline* pipeline : g_pipelines) {
+        const ScanBins& scan = *scans[pipeline->index];
+        if (scan.generation == 0 || start_ns - scan.completed_ns > OCCUPANCY_MAX_SCAN_AGE_MS * 1000000ULL) {
+            continue;
+        }
+        fuseScan(g_occupancy, scan, pipeline->config.mount_yaw_deg, static_cast<uint8_t>(pipeline->index));
+    }
+    endOccupancyUpdate(g_occupancy, start_ns);
+    recordStage(STAGE_FUSE, start_ns);
+
+    if (g_fused_lidar_feed && g_publish_lidar_data) {
+        uint64_t publish_ns = getMonotonicTimeNs();
+        try {
+            if (g_binary_lidar_frames || g_scan_shm) {
+                publishLidarFrame(buildOccupancyFrame(g_occupancy));
+            }
+            if (!g_binary_lidar_frames) {
+                publishOccupancyText(g_occupancy);
+            }
+            recordEvent(EVENT_PUBLISH_LIDAR, MAX_SENSORS, g_scan_sequence);
+            g_scan_sequence++;
+        } catch (const zmq::error_t& e) {
+            cerr << "Failed to send ZMQ message: " << e.what() << endl;
+        }
+        recordStage(STAGE_PUBLISH_LIDAR, publish_ns);
+    }
+}
+
+// Receive one detection message and correlate it with the latest scans
+void handleDetectionMessage() {
+    // The last two scans seen, so ranges can be moved to the camera frame's time
+    static ScanBins history[2];
+    static int latest = 0;
+
+    zmq::message_t detectionMsg;
+    if (!g_subscriber->recv(detectionMsg, zmq::recv_flags::dontwait)) {
+        return;
+    }
+    captureRecord(CAPTURE_DETECTION, detectionMsg.data(), detectionMsg.size());
+
+    // Correlate against the most recent completed scan of the camera's sensor.
+    // A scan with no returns has no clusters, so its detections are ranged
+    // from the occupancy grid alone.
+    uint64_t start_ns = getMonotonicTimeNs();
+    const ScanBins& scan = g_pipelines[0]->scans.read();
+    if (scan.generation == 0) {
+        return;
+    }
+    recordLatency(STAGE_SCAN_AGE, start_ns - scan.completed_ns);
+    if (scan.generation != history[latest].generation) {
+        latest ^= 1;
+        history[latest] = scan;
+    }
+    const ScanBins& previous = history[latest ^ 1];
+
+    int detectionCount = parseDetections(static_cast<const char*>(detectionMsg.data()), detectionMsg.size());
+    recordStage(STAGE_PARSE, start_ns);
+    recordEvent(EVENT_DETECTIONS, 0, static_cast<uint32_t>(detectionCount));
+    if (detectionCount > 0) {
+        uint64_t correlate_ns = getMonotonicTimeNs();
+        uint64_t detection_ns = detectionCaptureTime(start_ns);
+
+        int measurementCount = rangeDetections(history[latest], previous.generation ? &previous : nullptr,
+                                               detectionCount, detection_ns, &g_occupancy,
+                                               g_pipelines[0]->config.mount_yaw_deg);
+        if (measurementCount > 0) {
+            updateTracks(measurementCount, detection_ns / 1000000);
+        }
+        recordStage(STAGE_CORRELATE, correlate_ns);
+
+        // Publish objects immediately if we had new detections
+        if (measurementCount > 0) {
+            publishObjects(true);  // Force publish
+        }
+    }
+}
+
+// IMU thread: keep g_imu filled with yaw rates for deskewing, and take the
+// vehicle speed from messages that carry one
+void imuLoop() {
+    zmq::message_t message;
+    while (g_running) {
+        zmq::recv_result_t received;
+        try {
+            received = g_imu_subscriber->recv(message);
+        } catch (const zmq::error_t& e) {
+            if (e.num() != EINTR) throw;
+            continue;
+        }
+        if (!received) continue;  // Timed out; check g_running again
+
+        uint64_t receive_ns = getMonotonicTimeNs();
+        ImuReading reading;
+        if (!parseImuMessage(static_cast<const char*>(message.data()), message.size(), reading)) {
+            if (g_verbose) cerr << "Ignoring malformed IMU message" << endl;
+            continue;
+        }
+        recordImuSample(g_imu, steadyCaptureTime(reading.timestamp_us, receive_ns), reading.yaw_rate_dps);
+        if (reading.speed_mps >= 0.0f) {
+            g_vehicle_speed_mps.store(reading.speed_mps, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Tell the camera detector where sensor 0's near clusters are, once per
+// scan. An empty message means nothing is in range, so the detector can
+// slow down.
+void publishRoiHints() {
+    static uint32_t hinted_generation = 0;
+    static uint32_t sequence = 0;
+    static char frame[sizeof(RoiFrameHeader) + MAX_ROI_HINTS * sizeof(RoiHint)];
+
+    const ScanBins& scan = g_pipelines[0]->scans.read();
+    if (scan.generation == 0 || scan.generation == hinted_generation) {
+        return;
+    }
+    hinted_generation = scan.generation;
+
+    RoiHint* hints = reinterpret_cast<RoiHint*>(frame + sizeof(RoiFrameHeader));
+    int count = buildRoiHints(scan, g_config.camera_hfov_deg, g_config.camera_image_width, hints, MAX_ROI_HINTS);
+
+    RoiFrameHeader header = {};
+    memcpy(header.magic, ROI_FRAME_MAGIC, sizeof(header.magic));
+    header.version = ROI_FRAME_VERSION;
+    header.count = static_cast<uint16_t>(count);
+    header.sequence = sequence++;
+    header.timestamp_us = getCurrentTimeUs() - (getMonotonicTimeNs() - scan.completed_ns) / 1000;
+    memcpy(frame, &header, sizeof(header));
+
+    try {
+        zmq::message_t message(frame, sizeof(header) + count * sizeof(RoiHint));
+        g_roi_publisher->send(message, zmq::send_flags::dontwait);
+    } catch (const zmq::error_t& e) {
+        cerr << "Failed to send ZMQ message: " << e.what() << endl;
+    }
+}
+
+// Correlation thread: block on camera detections and publish fused objects
+void correlationLoop() {
+    zmq::pollitem_t items[] = {
+        { g_subscriber->handle(), 0, ZMQ_POLLIN, 0 }
+    };
+    uint64_t last_stats_time = getMonotonicTimeMs();
+
+    while (g_running) {
+        uint32_t force_publish_ms = g_force_publish_ms.load(std::memory_order_relaxed);
+
+        // Wake up at least every force_publish_ms for forced publishing, and
+        // more often when there are other sensors' scans to fuse or ROI
+        // hints to send. A signal landing on this thread interrupts the poll.
+        uint32_t timeout_ms = g_fused_lidar_feed || g_roi_publisher
+                                  ? std::min<uint32_t>(force_publish_ms, FUSION_POLL_MS)
+                                  : force_publish_ms;
+        try {
+            zmq::poll(items, 1, std::chrono::milliseconds(timeout_ms));
+        } catch (const zmq::error_t& e) {
+            if (e.num() != EINTR) throw;
+            items[0].revents = 0;
+        }
+
+        if (g_reload_config.exchange(false)) {
+            reloadConfig();
+        }
+        if (g_dump_flight_recorder.exchange(false)) {
+            if (dumpFlightRecorder()) {
+                cout << "Flight recorder dumped to " << g_flight_recorder_path << endl;
+            } else if (g_flight_recorder_path[0]) {
+                cerr << "Failed to dump flight recorder to " << g_flight_recorder_path << ": " << strerror(errno) << endl;
+            }
+        }
+
+        fuseSensors();
+        if (g_roi_publisher) {
+            publishRoiHints();
+        }
+        if (items[0].revents & ZMQ_POLLIN) {
+            handleDetectionMessage();
+        }
+
+        // Clean old objects periodically
+        cleanOldObjects();
+        
+        uint64_t current_time = getMonotonicTimeMs();
+        emitAlerts(current_time);
+
+        // Force publish periodically regardless of changes
+        if (g_profile.force_publish_objects && current_time - g_last_obj_publish_time >= force_publish_ms) {
+            publishObjects(true);  // Force publish
+        }
+
+        if (g_stats_publisher && current_time - last_stats_time >= STATS_INTERVAL_MS) {
+            publishStats(current_time - last_stats_time);
+            last_stats_time = current_time;
+        }
+    }
+}
+
+// The vehicle's motion over a grabbed revolution: the mean IMU yaw rate,
+// and the known vehicle speed (none while unknown)
+EgoMotion egoMotion(const ScanTiming& timing) {
+    EgoMotion motion = { 0.0f, 0.0f };
+    if (!meanYawRate(g_imu, timing.end_ns - timing.period_ns, timing.end_ns, motion.yaw_rate_dps)) {
+        motion.yaw_rate_dps = 0.0f;
+    }
+    motion.speed_mm_s = std::max(0.0f, g_vehicle_speed_mps.load(std::memory_order_relaxed)) * 1000.0f;
+    return motion;
+}
+
+// Stop and restart scanning in scan_mode after a failed grab
+bool restartScan(ILidarDriver* drv, sl_u16 scan_mode) {
+    drv->stop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(SCAN_DELAY_MS));
+    if (SL_IS_FAIL(drv->startScanExpress(false, scan_mode))) {
+        cerr << "Failed to restart scanning" << endl;
+        return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(SCAN_DELAY_MS));
+    return true;
+}
+
+class LidarScanSource : public ScanSource {
+public:
+    LidarScanSource(SensorPipeline& pipeline, ILidarDriver* drv) : pipeline(pipeline), drv(drv) {}
+
+    sl_result grabScan(sl_lidar_response_measurement_node_hq_t* nodes, size_t& count) override {
+        return drv->grabScanDataHq(nodes, count, GRAB_TIMEOUT_MS);
+    }
+    sl_result fetchNodes(sl_lidar_response_measurement_node_hq_t* nodes, size_t& count) override {
+        return drv->getScanDataWithIntervalHq(nodes, count);
+    }
+    void ascend(sl_lidar_response_measurement_node_hq_t* nodes, size_t count) override {
+        drv->ascendScanData(nodes, count);
+    }
+    bool restart() override { return restartScan(drv, pipeline.scan_mode.id); }
+
+    // Only the channel and driver are rebuilt; sockets and tracks stay up.
+    // The serial device may have re-enumerated, so it is opened afresh.
+    bool reconnect() override {
+        pipeline.releaseLidar();
+        drv = pipeline.initLidar();
+        return drv != nullptr;
+    }
+
+private:
+    SensorPipeline& pipeline;
+    ILidarDriver* drv;
+};
+
+// Plays a capture log back through the acquisition loops. Detection records
+// are published on REPLAY_DETECTIONS_ENDPOINT, which the detection
+// subscriber also connects to, as the replay timeline passes them. In real
+// time mode records are released at their captured spacing; otherwise as
+// fast as the loops consume them. The end of the log stops the pipeline.
+class ReplayScanSource : public ScanSource {
+public:
+    ReplayScanSource(zmq::context_t& context, bool realtime)
+        : detections(context, ZMQ_PUB), realtime(realtime) {
+        int linger = 0;
+        detections.set(zmq::sockopt::linger, linger);
+        detections.bind(REPLAY_DETECTIONS_ENDPOINT);
+    }
+
+    ~ReplayScanSource() override {
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+        detections.close();
+    }
+
+    // Map the log and check its header
+    bool open(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            cerr << "Failed to open replay file " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(CaptureFileHeader))) {
+            void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data = static_cast<const uint8_t*>(mapped);
+                size = st.st_size;
+            }
+        }
+        ::close(fd);
+
+        const CaptureFileHeader* header = reinterpret_cast<const CaptureFileHeader*>(data);
+        if (!data || memcmp(header->magic, CAPTURE_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != CAPTURE_FILE_VERSION ||
+            header->node_size != sizeof(sl_lidar_response_measurement_node_hq_t)) {
+            cerr << "Not a usable capture file: " << path << endl;
+            return false;
+        }
+        offset = sizeof(CaptureFileHeader);
+        return true;
+    }
+
+    sl_result grabScan(sl_lidar_response_measurement_node_hq_t* nodes, size_t& count) override {
+        return nextNodes(nodes, count);
+    }
+    sl_result fetchNodes(sl_lidar_response_measurement_node_hq_t* nodes, size_t& count) override {
+        return nextNodes(nodes, count);
+    }
+    void ascend(sl_lidar_response_measurement_node_hq_t* nodes, size_t count) override {
+        std::stable_sort(nodes, nodes + count,
+            [](const sl_lidar_response_measurement_node_hq_t& a, const sl_lidar_response_measurement_node_hq_t& b) {
+                return a.angle_z_q14 < b.angle_z_q14;
+            });
+    }
+    bool restart() override { return true; }
+
+    // A log cannot come back; stop the pipeline
+    bool reconnect() override {
+        g_running = false;
+        return false;
+    }
+
+private:
+    // Advance to the next node record, publishing detections on the way
+    sl_result nextNodes(sl_lidar_response_measurement_node_hq_t* nodes, size_t& count) {
+        size_t capacity = count;
+        count = 0;
+
+        while (offset + sizeof(CaptureRecordHeader) <= size) {
+            const CaptureRecordHeader* record = reinterpret_cast<const CaptureRecordHeader*>(data + offset);
+            const uint8_t* payload = data + offset + sizeof(CaptureRecordHeader);
+            if (offset + sizeof(CaptureRecordHeader) + record->size > size) break;  // Truncated final record
+            offset += sizeof(CaptureRecordHeader) + (record->size + 7) / 8 * 8;
+
+            waitUntil(record->timestamp_ns);
+
+            if (record->type == CAPTURE_DETECTION) {
+                try {
+                    zmq::message_t message(payload, record->size);
+                    detections.send(message, zmq::send_flags::dontwait);
+                } catch (const zmq::error_t&) {}
+            } else if (record->type == CAPTURE_NODES) {
+                count = std::min(capacity, record->size / sizeof(sl_lidar_response_measurement_node_hq_t));
+                memcpy(nodes, payload, count * sizeof(sl_lidar_response_measurement_node_hq_t));
+                return SL_RESULT_OK;
+            }
+        }
+
+        cout << "Replay finished" << endl;
+        g_running = false;
+        return SL_RESULT_OK;
+    }
+
+    // In real time mode, sleep until a record's captured offset has elapsed
+    void waitUntil(uint64_t timestamp_ns) {
+        if (!realtime) return;
+        uint64_t now = getMonotonicTimeNs();
+        if (log_start_ns == 0) {
+            log_start_ns = timestamp_ns;
+            replay_start_ns = now;
+        }
+        uint64_t due = replay_start_ns + (timestamp_ns - log_start_ns);
+        if (due > now) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        }
+    }
+
+    zmq::socket_t detections;
+    bool realtime;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    uint64_t log_start_ns = 0;     // Capture time of the first record
+    uint64_t replay_start_ns = 0;  // When that record was replayed
+};
+
+SensorPipeline::SensorPipeline(int index, const SensorConfig& config) : index(index), config(config) {
+    // Start on the live geometry; later reloads arrive through geometry_updates
+    geometry_updates.back() = g_config.geometry;
+    geometry_updates.publish();
+    applyGeometryUpdate();
+}
+
+SensorPipeline::~SensorPipeline() {
+    releaseLidar();
+    delete source;
+}
+
+bool SensorPipeline::open() {
+    ILidarDriver* lidar = initLidar();
+    if (!lidar) {
+        return false;
+    }
+    setSource(new LidarScanSource(*this, lidar));
+    return true;
+}
+
+void SensorPipeline::setSource(ScanSource* replacement) {
+    delete source;
+    source = replacement;
+}
+
+void SensorPipeline::start() {
+    thread = std::thread(config.stream_scan ? &SensorPipeline::streamingAcquisitionLoop : &SensorPipeline::acquisitionLoop,
+                         this);
+}
+
+void SensorPipeline::join() {
+    if (thread.joinable()) thread.join();
+}
+
+void SensorPipeline::releaseLidar() {
+    if (drv) {
+        if (g_verbose) cout << "Stopping LiDAR on " << config.serial_port << "..." << endl;
+        drv->stop();
+        delete drv;
+        drv = nullptr;
+    }
+    if (channel) {
+        if (g_verbose) cout << "Closing serial channel " << config.serial_port << "..." << endl;
+        delete channel;
+        channel = nullptr;
+    }
+}
+
+// Acquisition thread: adopt a reloaded geometry. Only called between scans,
+// so a scan is always binned with a single layout. Returns true on a change.
+bool SensorPipeline::applyGeometryUpdate() {
+    const ScanGeometry& update = geometry_updates.read();
+    if (update.version == context.geometry.version) {
+        return false;
+    }
+    context.geometry = update;
+    return true;
+}
+
+// Hand the filled back() slot to the correlation thread and publish it
+void SensorPipeline::publishScan() {
+    // Hand off first so fusion never waits on our own publishing.
+    // The slot is only read from here on.
+    ScanBins& scan = scans.back();
+    scan.completed_ns = getMonotonicTimeNs();
+    scans.publish();
+
+    // Send downsampled LIDAR data
+    if (publish_lidar && scan.valid_count > 0 && g_publish_lidar_data) {
+        uint64_t start_ns = getMonotonicTimeNs();
+        try {
+            if (g_binary_lidar_frames || g_scan_shm) {
+                publishLidarFrame(buildLidarFrame(scan));
+            }
+            if (!g_binary_lidar_frames) {
+                publishLidarText(scan);
+            }
+            recordEvent(EVENT_PUBLISH_LIDAR, static_cast<uint16_t>(index), g_scan_sequence);
+            g_scan_sequence++;
+        } catch (const zmq::error_t& e) {
+            cerr << "Failed to send ZMQ message: " << e.what() << endl;
+        }
+        recordStage(STAGE_PUBLISH_LIDAR, start_ns);
+    }
+}
+
+// Flag this sensor's data as stale (or fresh again) for OBJECTS consumers
+void SensorPipeline::setDegraded(bool now_degraded) {
+    if (degraded == now_degraded) {
+        return;
+    }
+    degraded = now_degraded;
+    g_degraded_sensors.fetch_add(degraded ? 1 : -1, std::memory_order_relaxed);
+
+    uint64_t now_ms = getMonotonicTimeMs();
+    if (degraded) {
+        degraded_since_ms = now_ms;
+        cerr << "LiDAR " << config.serial_port << " degraded, scan data is stale" << endl;
+    } else {
+        cout << "LiDAR " << config.serial_port << " recovered after " << now_ms - degraded_since_ms << " ms" << endl;
+    }
+}
+
+// Restarting the scan did not help: rebuild the connection with exponential
+// backoff until the source is back. False on shutdown, or at once when the
+// profile does not reconnect; that stops every sensor.
+bool SensorPipeline::recoverSource() {
+    if (!g_profile.reconnect) {
+        cerr << "LiDAR " << config.serial_port << " stopped responding, shutting down" << endl;
+        g_running = false;
+        return false;
+    }
+
+    uint32_t backoff_ms = RECONNECT_BACKOFF_MIN_MS;
+    while (g_running) {
+        if (source->reconnect()) {
+            return true;
+        }
+        if (g_verbose) cerr << "LiDAR reconnect failed, retrying in " << backoff_ms << " ms" << endl;
+
+        // Sleep in short steps so shutdown is not held up
+        uint64_t retry_ms = getMonotonicTimeMs() + backoff_ms;
+        while (g_running && getMonotonicTimeMs() < retry_ms) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(INIT_POLL_MS));
+        }
+        backoff_ms = std::min<uint32_t>(backoff_ms * 2, RECONNECT_BACKOFF_MAX_MS);
+    }
+    return false;
+}
+
+// Acquisition thread: grab full revolutions, bin them and publish them
+void SensorPipeline::acquisitionLoop() {
+    int consecutive_failures = 0;
+    const int MAX_CONSECUTIVE_FAILURES = 3;
+    ScanTiming timing = { 0, SCAN_PERIOD_MS * 1000000ULL, 0 };
+
+    while (g_running) {
+        size_t count = sizeof(nodes) / sizeof(nodes[0]);
+
+        // Grab scan data with timeout
+        uint64_t grab_ns = getMonotonicTimeNs();
+        sl_result result = source->grabScan(nodes, count);
+        if (SL_IS_FAIL(result)) {
+            recordEvent(EVENT_GRAB_FAILED, static_cast<uint16_t>(index), result);
+            if (g_verbose) cerr << "Failed to grab scan data" << endl;
+            consecutive_failures++;
+            setDegraded(true);
+            timing.end_ns = 0;  // The next grab does not follow on from the last one
+
+            // Restart the scan first; rebuild the connection once that stops helping
+            if (consecutive_failures >= MAX_CONSECUTIVE_FAILURES || !source->restart()) {
+                if (!recoverSource()) break;
+                consecutive_failures = 0;
+            }
+            continue;
+        }
+
+        // Reset failure counter on successful scan
+        consecutive_failures = 0;
+
+        // Check if we got any data
+        if (count == 0) {
+            if (g_verbose) cerr << "No scan data received" << endl;
+            continue;
+        }
+        setDegraded(false);
+        recordEvent(EVENT_SCAN_GRABBED, static_cast<uint16_t>(index), static_cast<uint32_t>(count));
+
+        uint64_t bin_ns = getMonotonicTimeNs();
+        recordLatency(STAGE_GRAB, bin_ns - grab_ns);
+        if (capture) captureRecord(CAPTURE_NODES, nodes, count * sizeof(nodes[0]));
+
+        // The grab returns as the revolution completes. Track the period from
+        // back-to-back grabs, ignoring intervals a stall or replay distorted.
+        if (timing.end_ns != 0) {
+            uint64_t interval_ns = bin_ns - timing.end_ns;
+            if (interval_ns > timing.period_ns / 2 && interval_ns < timing.period_ns * 2) {
+                timing.period_ns = (timing.period_ns * 7 + interval_ns) / 8;
+            }
+        }
+        timing.end_ns = bin_ns;
+        timing.start_angle_q14 = nodes[0].angle_z_q14;
+        source->ascend(nodes, count);
+
+        // Undo the vehicle's own turn and travel during the revolution
+        if (deskew) deskewScan(nodes, count, timing, egoMotion(timing), config.mount_yaw_deg);
+
+        // Bin and cluster into the writer's slot
+        applyGeometryUpdate();
+        binScan(context, scans.back(), nodes, count, timing);
+        recordStage(STAGE_BIN, bin_ns);
+
+        publishScan();
+        adjustMotorSpeed();
+    }
+}
+
+// Copy the live sweep bins and clusters into the writer's slot and publish
+// them. Previous-pass clusters are only used below cutoff_deg, the part of
+// the arc this pass has not reached yet.
+void SensorPipeline::publishSweep(float cutoff_deg) {
+    ScanBins& scan = scans.back();
+    beginScanBins(context, scan);
+    for (int i = 0; i < scan.geometry.num_buckets; i++) {
+        if (isBinValid(sweep.live, i)) {
+            updateBin(scan, i, sweep.live.bins[i].distance_mm, sweep.live.bins[i].capture_ns);
+        }
+    }
+
+    // Both lists are in descending angle order; emit ascending
+    scan.cluster_count = 0;
+    for (int i = sweep.prev_count - 1; i >= 0; i--) {
+        if (sweep.prev_clusters[i].max_angle_deg < cutoff_deg) {
+            scan.clusters[scan.cluster_count++] = sweep.prev_clusters[i];
+        }
+    }
+    for (int i = sweep.pass_count - 1; i >= 0 && scan.cluster_count < MAX_SCAN_CLUSTERS; i--) {
+        scan.clusters[scan.cluster_count++] = sweep.pass_clusters[i];
+    }
+    publishScan();
+}
+
+// Feed one node, measured at capture_ns, into the sweep; publishes when a
+// sector or the arc completes
+void SensorPipeline::processStreamNode(const sl_lidar_response_measurement_node_hq_t& node, uint64_t capture_ns) {
+    uint16_t code = classifyNode(context.geometry, node);
+
+    // Leaving the front arc completes the sweep; the rear half is skipped
+    if (code == NODE_OUTSIDE_ARC) {
+        if (sweep.current_bucket >= 0) {
+            closeCluster(sweep.builder, sweep.pass_clusters, sweep.pass_count);
+            publishSweep(-FRONT_ARC_DEG);
+            sweep.current_bucket = -1;
+            sweep.buckets_since_publish = 0;
+            sweep.live.valid_count = 0;  // Not meaningful for live bins; keep it bounded
+
+            // This pass becomes the fallback for the next one
+            std::copy(sweep.pass_clusters, sweep.pass_clusters + sweep.pass_count, sweep.prev_clusters);
+            sweep.prev_count = sweep.pass_count;
+            sweep.pass_count = 0;
+            sweep.last_angle = FRONT_ARC_DEG;
+
+            // A reloaded bucket layout starts with the next pass
+            if (applyGeometryUpdate()) {
+                for (AngleBin& bin : sweep.live.bins) bin.generation = 0;
+            }
+            adjustMotorSpeed();
+        }
+        return;
+    }
+
+    int bucketIndex = code & NODE_BUCKET_MASK;
+    float angle = arcAngleDegrees(node.angle_z_q14);
+    if (bucketIndex != sweep.current_bucket) {
+        // Publish each time another sector's worth of buckets has completed
+        if (sweep.current_bucket >= 0 && ++sweep.buckets_since_publish >= streamSectorBuckets(context.geometry)) {
+            publishSweep(sweep.last_angle);
+            sweep.buckets_since_publish = 0;
+        }
+
+        // Entering a bucket (and any skipped on the way) drops its previous pass
+        if (sweep.current_bucket >= 0) {
+            int step = bucketIndex > sweep.current_bucket ? 1 : -1;
+            for (int i = sweep.current_bucket + step; i != bucketIndex; i += step) {
+                sweep.live.bins[i].generation = 0;
+            }
+        }
+        sweep.live.bins[bucketIndex].generation = 0;
+        sweep.current_bucket = bucketIndex;
+    }
+
+    sweep.last_angle = std::min(sweep.last_angle, angle);
+    if (code & NODE_OUT_OF_RANGE) {
+        closeCluster(sweep.builder, sweep.pass_clusters, sweep.pass_count);
+    } else if (!(code & NODE_NO_RETURN)) {
+        float distance = node.dist_mm_q2 / 4.0f;
+        segmentPoint(sweep.builder, angle, distance, capture_ns, sweep.pass_clusters, sweep.pass_count);
+        updateBin(sweep.live, bucketIndex, distance, capture_ns);
+    }
+}
+
+// Acquisition thread, streaming mode: consume nodes as the SDK receives them
+// and publish front-arc sectors as soon as they complete instead of waiting
+// for the full revolution
+void SensorPipeline::streamingAcquisitionLoop() {
+    int consecutive_failures = 0;
+    const int MAX_CONSECUTIVE_FAILURES = 3;
+    uint64_t last_data_time = getMonotonicTimeMs();
+    uint64_t last_fetch_ns = getMonotonicTimeNs();
+    sweep.live.generation = 1;
+
+    while (g_running) {
+        size_t count = sizeof(nodes) / sizeof(nodes[0]);
+        uint64_t grab_ns = getMonotonicTimeNs();
+        sl_result result = source->fetchNodes(nodes, count);
+
+        if (result == SL_RESULT_OPERATION_TIMEOUT || (SL_IS_OK(result) && count == 0)) {
+            // Nothing buffered yet; only a long silence counts as a failure
+            if (getMonotonicTimeMs() - last_data_time < STREAM_STALL_MS) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(STREAM_POLL_MS));
+                continue;
+            }
+            result = SL_RESULT_OPERATION_TIMEOUT;
+        }
+
+        if (SL_IS_FAIL(result)) {
+            recordEvent(EVENT_GRAB_FAILED, static_cast<uint16_t>(index), result);
+            if (g_verbose) cerr << "Failed to fetch streaming scan data" << endl;
+            consecutive_failures++;
+            setDegraded(true);
+
+            // Restart the scan first; rebuild the connection once that stops helping
+            if (consecutive_failures >= MAX_CONSECUTIVE_FAILURES || !source->restart()) {
+                if (!recoverSource()) break;
+                consecutive_failures = 0;
+            }
+            sweep.current_bucket = -1;
+            closeCluster(sweep.builder, sweep.pass_clusters, sweep.pass_count);
+            last_data_time = getMonotonicTimeMs();
+            continue;
+        }
+
+        consecutive_failures = 0;
+        setDegraded(false);
+        recordEvent(EVENT_SCAN_GRABBED, static_cast<uint16_t>(index), static_cast<uint32_t>(count));
+        uint64_t bin_ns = getMonotonicTimeNs();
+        recordLatency(STAGE_GRAB, bin_ns - grab_ns);
+        last_data_time = bin_ns / 1000000;
+        if (capture) captureRecord(CAPTURE_NODES, nodes, count * sizeof(nodes[0]));
+
+        // The nodes arrived evenly since the previous fetch; spread their
+        // capture times over that span, at most one revolution
+        uint64_t span_ns = std::min<uint64_t>(bin_ns - last_fetch_ns, SCAN_PERIOD_MS * 1000000ULL);
+        last_fetch_ns = bin_ns;
+
+        // Sector publishes happen inside this loop, so in streaming mode the
+        // bin stage also includes publish_lidar
+        for (size_t i = 0; i < count; i++) {
+            processStreamNode(nodes[i], bin_ns - span_ns + span_ns * (i + 1) / count);
+        }
+        recordStage(STAGE_BIN, bin_ns);
+    }
+}
+
+// Poll ready() every INIT_POLL_MS until it holds; false after timeout_ms or on shutdown
+template <typename Ready>
+bool waitUntil(Ready ready, uint32_t timeout_ms) {
+    uint64_t deadline = getMonotonicTimeMs() + timeout_ms;
+    while (!ready()) {
+        if (!g_running || getMonotonicTimeMs() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(INIT_POLL_MS));
+    }
+    return true;
+}
+
+// Bytes on the serial link per sample for a scan mode's answer type.
+// Formats not listed are costed as standard nodes.
+float scanModeBytesPerSample(sl_u8 ans_type) {
+    switch (ans_type) {
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED: return 84.0f / 32;        // Express
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED: return 84.0f / 40;  // Boost, Sensitivity, ...
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA: return 132.0f / 96;
+        default: return 5.0f;                                                  // Standard
+    }
+}
+
+// Index into modes of the one with the highest sample rate the serial link
+// at baudrate carries (8N1, so 10 bits a byte). Ties go to typical. -1 if
+// none fits.
+int selectScanMode(const vector<LidarScanMode>& modes, int baudrate, sl_u16 typical) {
+    double link_bytes_per_s = baudrate / 10.0;
+    int best = -1;
+    for (size_t i = 0; i < modes.size(); i++) {
+        const LidarScanMode& mode = modes[i];
+        if (mode.us_per_sample <= 0.0f) continue;
+        double samples_per_s = 1e6 / mode.us_per_sample;
+        if (samples_per_s * scanModeBytesPerSample(mode.ans_type) > link_bytes_per_s) continue;
+        if (best < 0 || mode.us_per_sample < modes[best].us_per_sample ||
+            (mode.us_per_sample == modes[best].us_per_sample && mode.id == typical)) {
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+// Motor speed for a vehicle speed: the lowest (finest resolution, least
+// power) when stopped, rising to the highest (most revolutions a second)
+// at MOTOR_FULL_SPEED_MPS. The device default when either is unknown.
+sl_u16 targetMotorSpeed(const LidarMotorInfo& motor, float vehicle_speed_mps) {
+    if (motor.motorCtrlSupport == MotorCtrlSupportNone || vehicle_speed_mps < 0.0f) {
+        return DEFAULT_MOTOR_SPEED;
+    }
+    float lowest = std::max<float>(motor.min_speed, motor.desired_speed * MOTOR_IDLE_RATIO);
+    float highest = std::max<float>(lowest, motor.max_speed);
+    float t = std::min(1.0f, vehicle_speed_mps / static_cast<float>(MOTOR_FULL_SPEED_MPS));
+    return static_cast<sl_u16>(lowest + (highest - lowest) * t + 0.5f);
+}
+
+void SensorPipeline::adjustMotorSpeed() {
+    if (!drv || motor.motorCtrlSupport == MotorCtrlSupportNone) return;
+
+    sl_u16 target = targetMotorSpeed(motor, g_vehicle_speed_mps.load(std::memory_order_relaxed));
+    if (target == motor_speed) return;
+    if (target != DEFAULT_MOTOR_SPEED && motor_speed != DEFAULT_MOTOR_SPEED) {
+        float deadband = (motor.max_speed - motor.min_speed) * static_cast<float>(MOTOR_SPEED_DEADBAND);
+        if (std::abs(static_cast<float>(target) - motor_speed) < deadband) return;
+    }
+
+    if (SL_IS_FAIL(drv->setMotorSpeed(target))) {
+        if (g_verbose) cerr << config.serial_port << ": failed to set motor speed " << target << endl;
+        return;
+    }
+    motor_speed = target;
+    if (g_verbose) {
+        cout << config.serial_port << ": motor speed " << target
+             << (motor.motorCtrlSupport == MotorCtrlSupportRpm ? " rpm" : " pwm") << endl;
+    }
+}
+
+// Start scanning in the densest mode the serial link carries, or the
+// device's typical mode when the modes cannot be listed
+bool SensorPipeline::startScanning(ILidarDriver* lidar) {
+    vector<LidarScanMode> modes;
+    sl_u16 typical = 0;
+    int chosen = -1;
+    if (SL_IS_OK(lidar->getAllSupportedScanModes(modes)) && SL_IS_OK(lidar->getTypicalScanMode(typical))) {
+        chosen = selectScanMode(modes, config.serial_baudrate, typical);
+    }
+    sl_result result = chosen >= 0 ? lidar->startScanExpress(false, modes[chosen].id, 0, &scan_mode)
+                                   : lidar->startScan(0, 1, 0, &scan_mode);
+    if (SL_IS_FAIL(result)) return false;
+
+    cout << "Scan mode: " << scan_mode.scan_mode;
+    if (scan_mode.us_per_sample > 0.0f) cout << ", " << static_cast<int>(1e6 / scan_mode.us_per_sample) << " samples/s";
+    cout << (chosen >= 0 ? "" : " (typical)") << endl;
+    return true;
+}
+
+// Release a LiDAR that failed to initialize
+ILidarDriver* SensorPipeline::abortLidarInit(const char* message) {
+    cerr << config.serial_port << ": " << message << endl;
+    delete drv;
+    drv = nullptr;
+    delete channel;
+    channel = nullptr;
+    return nullptr;
+}
+
+// Connect to this sensor's LiDAR, check its health and start scanning. Each
+// step waits only until the device reports ready, with INIT_DELAY_MS as the
+// upper bound, and the first revolution with real returns marks the end of
+// startup. Returns the driver, or nullptr on failure.
+ILidarDriver* SensorPipeline::initLidar() {
+    uint64_t start_ms = getMonotonicTimeMs();
+
+    Result<IChannel*> serial = createSerialPortChannel(config.serial_port, config.serial_baudrate);
+    if (!serial) {
+        cerr << "Failed to create serial port channel for " << config.serial_port << endl;
+        return nullptr;
+    }
+    channel = *serial;
+
+    Result<ILidarDriver*> driver = createLidarDriver();
+    if (!driver) {
+        return abortLidarInit("Failed to create LiDAR driver");
+    }
+    drv = *driver;
+    ILidarDriver* lidar = drv;
+
+    if (SL_IS_FAIL(lidar->connect(channel))) {
+        return abortLidarInit("Failed to connect to LiDAR");
+    }
+
+    // Stop any existing scan; the device is idle again once it answers a
+    // health request
+    lidar->stop();
+    sl_lidar_response_device_health_t healthinfo;
+    if (!waitUntil([&] { return SL_IS_OK(lidar->getHealth(healthinfo, INIT_POLL_MS)); }, INIT_DELAY_MS)) {
+        return abortLidarInit("Failed to get health info");
+    }
+    if (healthinfo.status != SL_LIDAR_STATUS_OK) {
+        cerr << "LiDAR health status: " << healthinfo.status << endl;
+        return abortLidarInit("LiDAR is not healthy");
+    }
+
+    // Start the motor at the speed for the current vehicle speed; without
+    // speed control it runs at its fixed rate
+    if (SL_IS_FAIL(lidar->getMotorInfo(motor))) {
+        motor = {};
+    }
+    motor_speed = targetMotorSpeed(motor, g_vehicle_speed_mps.load(std::memory_order_relaxed));
+    if (SL_IS_FAIL(lidar->setMotorSpeed(motor_speed))) {
+        return abortLidarInit("Failed to set motor speed");
+    }
+
+    // Query the device while the motor spins up
+    sl_lidar_response_device_info_t devinfo;
+    if (SL_IS_FAIL(lidar->getDeviceInfo(devinfo))) {
+        return abortLidarInit("Failed to get device info");
+    }
+    cout << "LiDAR on " << config.serial_port << ":" << endl;
+    cout << "LiDAR health status: " << healthinfo.status << endl;
+    cout << "Device model: " << devinfo.model << endl;
+    cout << "Firmware version: " << devinfo.firmware_version << endl;
+    cout << "Hardware version: " << devinfo.hardware_version << endl;
+    cout << "Serial number: " << devinfo.serialnum << endl;
+
+    if (!startScanning(lidar)) {
+        return abortLidarInit("Failed to start scanning");
+    }
+
+    // Ready once the motor is up to speed and a revolution has real returns.
+    // Each probe waits about two revolutions, so a grab that times out while
+    // the motor spins up does not use up the whole window. Acquisition
+    // retries on its own if that takes longer.
+    bool scanning = waitUntil([&] {
+        size_t count = MAX_SCAN_NODES;
+        if (SL_IS_FAIL(lidar->grabScanDataHq(nodes, count, SCAN_PERIOD_MS * 2))) return false;
+        return std::any_of(nodes, nodes + count, [](const sl_lidar_response_measurement_node_hq_t& node) {
+            return node.dist_mm_q2 != 0;
+        });
+    }, INIT_DELAY_MS);
+
+    if (scanning) {
+        cout << "LiDAR " << config.serial_port << " initialized successfully in "
+             << getMonotonicTimeMs() - start_ms << " ms" << endl;
+    } else {
+        cerr << config.serial_port << ": no valid scan within " << INIT_DELAY_MS << " ms, continuing" << endl;
+    }
+    return lidar;
+}
+
+int runPipeline(int argc, const char *argv[], const PipelineProfile& profile) {
+    g_profile = profile;
+    g_config = profileConfig();
+    snprintf(g_flight_recorder_path, sizeof(g_flight_recorder_path), "%s", g_config.flight_recorder_path.c_str());
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+    signal(SIGUSR1, signalHandler);  // Add signal for toggling LIDAR publishing
+    signal(SIGUSR2, signalHandler);  // Dump the flight recorder
+    signal(SIGHUP, signalHandler);   // Reload the --config file
+    for (int signum : { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT }) {
+        signal(signum, crashHandler);
+    }
+    
+    const char* capturePath = nullptr;
+    const char* replayPath = nullptr;
+    bool replayRealtime = true;
+
+    // Check command line arguments for initial state
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-lidar-publish") == 0) {
+            g_publish_lidar_data = false;
+            cout << "Starting with LIDAR data publishing disabled" << endl;
+        } else if (strcmp(argv[i], "--stream-scan") == 0) {
+            g_stream_scan = true;
+            cout << "Streaming front-arc sectors as nodes arrive" << endl;
+        } else if (strcmp(argv[i], "--binary-lidar") == 0) {
+            g_binary_lidar_frames = true;
+            cout << "Publishing LIDAR data as binary " << LIDAR_FRAME_MAGIC << " frames" << endl;
+        } else if (strcmp(argv[i], "--objects-delta") == 0) {
+            g_objects_delta = true;
+            cout << "Publishing OBJECTS_DELTA changes between OBJECTS keyframes" << endl;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capturePath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay-fast") == 0) {
+            replayRealtime = false;
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            g_config_path = argv[++i];
+        }
+    }
+
+    if (g_config_path) {
+        RuntimeConfig config;
+        if (!loadConfig(g_config_path, config)) return -1;
+        applyConfig(config);
+        snprintf(g_flight_recorder_path, sizeof(g_flight_recorder_path), "%s", config.flight_recorder_path.c_str());
+        cout << "Loaded " << g_config_path << ": " << config.geometry.bucket_size_deg << " deg buckets, "
+             << config.geometry.max_distance_mm << " mm range" << endl;
+    }
+
+    if (capturePath) {
+        if (!openCapture(capturePath)) return -1;
+        cout << "Capturing scans and detections to " << capturePath << endl;
+    }
+
+    if (!g_config.scan_shm.empty()) {
+        if (!openScanShm(g_config.scan_shm)) return -1;
+        cout << "Writing scans to shared memory " << g_config.scan_shm << endl;
+    }
+
+    if (g_binary_lidar_frames || g_scan_shm) {
+        g_frame_buffer.reserve(MAX_LIDAR_FRAME_BYTES);
+    }
+
+    initClassTable();
+
+    // Pre-size OBJECTS buffers so serialization does not allocate
+    for (ObjectsBuffer& buffer : g_objects_buffers) {
+        buffer.data.reserve(OBJECTS_BUFFER_RESERVE);
+    }
+    
+    // One pipeline per sensor; without --config, the single default LiDAR
+    vector<SensorConfig> sensors = g_config.sensors;
+    if (sensors.empty()) {
+        SensorConfig sensor;
+        sensor.serial_port = g_config.serial_port;
+        sensor.serial_baudrate = g_config.serial_baudrate;
+        sensors.push_back(sensor);
+    }
+    if (replayPath && sensors.size() > 1) {
+        cerr << "Replay covers the first sensor only; ignoring the other " << sensors.size() - 1 << endl;
+        sensors.resize(1);
+    }
+    for (size_t i = 0; i < sensors.size(); i++) {
+        sensors[i].stream_scan = sensors[i].stream_scan || g_stream_scan;
+        g_pipelines.push_back(new SensorPipeline(static_cast<int>(i), sensors[i]));
+    }
+    g_pipelines[0]->capture = true;
+    // With several sensors the HUD is fed from the occupancy grid, so it sees
+    // one all-round view. A single sensor keeps publishing its own binned
+    // scans, frame for frame as before.
+    g_fused_lidar_feed = g_pipelines.size() > 1;
+    for (SensorPipeline* pipeline : g_pipelines) {
+        pipeline->publish_lidar = !g_fused_lidar_feed;
+    }
+
+    // Bring the LiDARs up in the background while the sockets are set up
+    vector<std::future<bool>> lidarsReady;
+    if (!replayPath) {
+        for (SensorPipeline* pipeline : g_pipelines) {
+            lidarsReady.push_back(std::async(std::launch::async, &SensorPipeline::open, pipeline));
+        }
+    }
+
+    // TCP ports or full endpoints, see RuntimeConfig
+    string address_pub = zmqEndpoint(g_config.zmq_port_pub, "*");
+    string address_obj = zmqEndpoint(g_config.zmq_port_obj, "*");
+    string address_stats = g_config.zmq_port_stats.empty() ? "" : zmqEndpoint(g_config.zmq_port_stats, "*");
+    string address_sub = zmqEndpoint(g_config.zmq_port_sub, "localhost");
+    // A replayed scan is not deskewed (see below), so it needs no yaw rates
+    string address_imu = g_config.zmq_port_imu.empty() || replayPath ? "" : zmqEndpoint(g_config.zmq_port_imu, "localhost");
+    string address_roi = g_config.zmq_port_roi.empty() ? "" : zmqEndpoint(g_config.zmq_port_roi, "*");
+
+    // Initialize ZMQ with optimized settings
+    try {
+        g_context = new zmq::context_t(1);
+        g_publisher = new zmq::socket_t(*g_context, ZMQ_PUB);
+        g_corr_publisher = new zmq::socket_t(*g_context, ZMQ_PUB);
+        g_subscriber = new zmq::socket_t(*g_context, ZMQ_SUB);
+
+        // Set high water mark to 1 to prevent message queuing
+        int hwm = 1;
+        g_publisher->set(zmq::sockopt::sndhwm, hwm);
+        g_corr_publisher->set(zmq::sockopt::sndhwm, hwm);
+        g_subscriber->set(zmq::sockopt::rcvhwm, hwm);
+
+        // Set CONFLATE option to only keep latest message
+        int conflate = g_profile.conflate ? 1 : 0;
+        g_publisher->set(zmq::sockopt::conflate, conflate);
+        g_corr_publisher->set(zmq::sockopt::conflate, conflate);
+        g_subscriber->set(zmq::sockopt::conflate, conflate);
+
+        // Set socket options for performance
+        int linger = 0;
+        g_publisher->set(zmq::sockopt::linger, linger);
+        g_corr_publisher->set(zmq::sockopt::linger, linger);
+        g_subscriber->set(zmq::sockopt::linger, linger);
+
+        g_publisher->bind(address_pub);
+        g_corr_publisher->bind(address_obj);
+        g_subscriber->connect(address_sub);
+        g_subscriber->set(zmq::sockopt::subscribe, "");
+
+        if (!address_stats.empty()) {
+            g_stats_publisher = new zmq::socket_t(*g_context, ZMQ_PUB);
+            g_stats_publisher->set(zmq::sockopt::sndhwm, hwm);
+            g_stats_publisher->set(zmq::sockopt::conflate, conflate);
+            g_stats_publisher->set(zmq::sockopt::linger, linger);
+            g_stats_publisher->bind(address_stats);
+        }
+
+        // Every IMU sample counts, so no conflation here; the timeout lets
+        // the IMU thread notice shutdown
+        if (!address_imu.empty()) {
+            g_imu_subscriber = new zmq::socket_t(*g_context, ZMQ_SUB);
+            g_imu_subscriber->set(zmq::sockopt::linger, linger);
+            g_imu_subscriber->set(zmq::sockopt::rcvtimeo, IMU_RECV_TIMEOUT_MS);
+            g_imu_subscriber->connect(address_imu);
+            g_imu_subscriber->set(zmq::sockopt::subscribe, "");
+        }
+
+        // Only the latest hints matter to the detector
+        if (!address_roi.empty()) {
+            g_roi_publisher = new zmq::socket_t(*g_context, ZMQ_PUB);
+            g_roi_publisher->set(zmq::sockopt::sndhwm, hwm);
+            g_roi_publisher->set(zmq::sockopt::conflate, conflate);
+            g_roi_publisher->set(zmq::sockopt::linger, linger);
+            g_roi_publisher->bind(address_roi);
+        }
+
+        // Replayed detections arrive over inproc alongside any live publisher
+        if (replayPath) {
+            ReplayScanSource* replay = new ReplayScanSource(*g_context, replayRealtime);
+            g_pipelines[0]->setSource(replay);
+            // The recorded motion is not the current vehicle_speed_mps or
+            // IMU, so correcting for those would distort the replay
+            g_pipelines[0]->deskew = false;
+            if (!replay->open(replayPath)) {
+                cleanup();
+                return -1;
+            }
+            g_subscriber->connect(REPLAY_DETECTIONS_ENDPOINT);
+            cout << "Replaying " << replayPath << (replayRealtime ? " in real time" : " as fast as possible") << endl;
+        }
+    } catch (const zmq::error_t& e) {
+        cerr << "Failed to initialize ZMQ: " << e.what() << endl;
+        for (std::future<bool>& ready : lidarsReady) ready.wait();
+        cleanup();
+        return -1;
+    }
+
+    // A replay never drives the helmet
+    bool sendAlerts = !g_config.alert_port.empty() && !replayPath;
+
+    bool lidarsOpen = true;
+    for (std::future<bool>& ready : lidarsReady) {
+        lidarsOpen = ready.get() && lidarsOpen;
+    }
+    if (!lidarsOpen) {
+        cleanup();
+        return -1;
+    }
+
+    cout << "LiDAR system initialized:" << endl
+         << "- Publishing LIDAR data on " << address_pub << (g_binary_lidar_frames ? " (binary)" : "")
+         << (g_publish_lidar_data ? "" : " (disabled)") << endl
+         << "- Publishing correlated objects on " << address_obj << endl
+         << "- Publishing pipeline stats on " << (address_stats.empty() ? "nothing" : address_stats.c_str()) << endl
+         << "- Subscribing to camera detections on " << address_sub << endl
+         << "- Publishing ROI hints on " << (address_roi.empty() ? "nothing" : address_roi.c_str()) << endl
+         << "- Subscribing to IMU yaw rates on " << (address_imu.empty() ? "nothing" : address_imu.c_str()) << endl
+         << "- Sending alerts to " << (sendAlerts ? g_config.alert_port.c_str() : "nothing")
+         << (replayPath && !g_config.alert_port.empty() ? " (replaying)" : "") << endl
+         << "- Send SIGUSR1 signal to toggle LIDAR data publishing" << endl
+         << "- Send SIGUSR2 signal to dump the flight recorder to "
+         << (g_flight_recorder_path[0] ? g_flight_recorder_path : "nothing") << endl
+         << "- Send SIGHUP signal to reload " << (g_config_path ? g_config_path : "the --config file") << endl;
+    for (SensorPipeline* pipeline : g_pipelines) {
+        cout << "- Sensor " << pipeline->index << ": " << (replayPath ? replayPath : pipeline->config.serial_port.c_str())
+             << ", facing " << pipeline->config.mount_yaw_deg << " deg"
+             << (pipeline->config.stream_scan ? " (streaming)" : "") << endl;
+    }
+    cout << "System running..." << endl;
+
+    // Acquisition and correlation run independently so detections are
+    // correlated as soon as they arrive instead of once per revolution. Each
+    // sensor has its own acquisition thread.
+    if (sendAlerts) {
+        g_alert_thread = std::thread(alertWriterLoop, g_config.alert_port);
+    }
+    std::thread correlationThread(correlationLoop);
+    std::thread imuThread;
+    if (g_imu_subscriber) {
+        imuThread = std::thread(imuLoop);
+    }
+    for (SensorPipeline* pipeline : g_pipelines) {
+        pipeline->start();
+    }
+    for (SensorPipeline* pipeline : g_pipelines) {
+        pipeline->join();
+    }
+    g_running = false;
+    correlationThread.join();
+    if (imuThread.joinable()) imuThread.join();
+
+    // Cleanup before exit
+    cleanup();
+    return 0;
+}
@@ -0,0 +1,26 @@
+// The LiDAR pipeline shared by every deployment: acquisition, binning,
+// camera correlation, tracking and the ZMQ outputs, all in
+// lidar_pipeline.cpp. Each deployment is a thin main() that picks a
+// PipelineProfile and hands over to runPipeline().
+#pragma once
+
+#include "lidar_core.h"
+
+// What differs between deployments. The defaults are the root
+// lidar_zmq_refined build; --config can still override bucket_size_deg, but
+// not turn a disabled output back on.
+struct PipelineProfile {
+    double bucket_size_deg = ANGLE_BUCKET_SIZE;  // Default angle_bucket_size_deg
+    bool conflate = true;               // Keep only the latest message on the publish and detection sockets
+    bool force_publish_objects = true;  // Republish OBJECTS every force_publish_ms, not only after detections
+    bool reconnect = true;              // Rebuild a LiDAR connection that stops responding instead of exiting
+    bool alerts = true;                 // Write alert packets to alert_port
+    bool stats = true;                  // Publish STATS on zmq_port_stats
+    bool imu = true;                    // Deskew with IMU yaw rates from zmq_port_imu
+    bool roi = true;                    // Publish ROI hints on zmq_port_roi
+    bool flight_recorder = true;        // Dump the flight recorder to flight_recorder_path
+};
+
+// Parse the command line, bring up the sensors and sockets and run until
+// SIGINT/SIGTERM or acquisition stops. Returns the process exit status.
+int runPipeline(int argc, const char* argv[], const PipelineProfile& profile);
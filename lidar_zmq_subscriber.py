@@ -1,23 +1,101 @@
 import zmq
 import time
+import struct
+import sys
+import mmap
+
+# Binary frame layout published by lidar_zmq_refined --binary-lidar
+LIDAR_FRAME_MAGIC = b"LBIN"
+LIDAR_FRAME_HEADER = struct.Struct("<4sHHIIQ")  # magic, version, count, seq, bucket_cdeg, ts_ns
+
+try:
+    import numpy as np
+    LIDAR_POINT_DTYPE = np.dtype([('angle_cdeg', '<i2'), ('dist_mm', '<u2')])
+except ImportError:
+    np = None
+
+def parse_binary_frame(message):
+    """Return (header, points) for a binary LIDAR frame without string parsing"""
+    magic, version, count, seq, bucket_cdeg, ts_ns = LIDAR_FRAME_HEADER.unpack_from(message)
+    header = {'version': version, 'count': count, 'sequence': seq,
+              'bucket_deg': bucket_cdeg / 100.0, 'timestamp_ns': ts_ns}
+    if np is not None:
+        points = np.frombuffer(message, dtype=LIDAR_POINT_DTYPE, count=count,
+                               offset=LIDAR_FRAME_HEADER.size)
+    else:
+        points = list(struct.iter_unpack("<hH", message[LIDAR_FRAME_HEADER.size:]))
+    return header, points
+
+# Shared-memory scan ring written by lidar_zmq_refined with "scan_shm" in its
+# --config: a header, then slots each holding one binary LIDAR frame
+SCAN_SHM_MAGIC = b"LSHM"
+SCAN_SHM_HEADER = struct.Struct("<4sHHIIQ")  # magic, version, slots, slot_size, reserved, write_count
+SCAN_SHM_SLOT = struct.Struct("<II")  # sequence (odd while written), frame_size
+
+def open_scan_shm(name):
+    """Map the scan ring created under name, e.g. "/lidar-scans" """
+    with open("/dev/shm/" + name.lstrip("/"), "rb") as f:
+        return mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+
+def read_scan_shm(shm):
+    """Return (write_count, frame) for the newest complete frame, or None if there is none yet"""
+    while True:
+        magic, version, slots, slot_size, _, count = SCAN_SHM_HEADER.unpack_from(shm)
+        if magic != SCAN_SHM_MAGIC or count == 0:
+            return None
+        offset = SCAN_SHM_HEADER.size + ((count - 1) % slots) * slot_size
+        sequence, size = SCAN_SHM_SLOT.unpack_from(shm, offset)
+        if sequence & 1:
+            continue  # Being rewritten
+        start = offset + SCAN_SHM_SLOT.size
+        frame = shm[start:start + size]
+        if SCAN_SHM_SLOT.unpack_from(shm, offset)[0] == sequence:
+            return count, frame
+
+if len(sys.argv) > 2 and sys.argv[1] == "--shm":
+    # Poll the ring instead of subscribing; each new write_count is a new scan
+    shm = open_scan_shm(sys.argv[2])
+    print(f"Reading scans from shared memory {sys.argv[2]}")
+    last_count = 0
+    try:
+        while True:
+            latest = read_scan_shm(shm)
+            if latest and latest[0] != last_count:
+                last_count, frame = latest
+                header, points = parse_binary_frame(frame)
+                if header['sequence'] % 10 == 0:
+                    print(f"Shared memory frame seq {header['sequence']}: {header['count']} points")
+            time.sleep(0.005)
+    except KeyboardInterrupt:
+        print("\nStopping reader...")
+    sys.exit(0)
 
 print("Initializing ZMQ subscriber...")
 context = zmq.Context()
 subscriber = context.socket(zmq.SUB)
 
 print("Connecting to publisher...")
-subscriber.connect("tcp://localhost:5556")
+endpoint = sys.argv[1] if len(sys.argv) > 1 else "tcp://localhost:5556"  # e.g. ipc:///tmp/lidar-scans
+subscriber.connect(endpoint)
 print("Setting subscription filter...")
 subscriber.setsockopt_string(zmq.SUBSCRIBE, "LIDAR_DATA")
+subscriber.setsockopt(zmq.SUBSCRIBE, LIDAR_FRAME_MAGIC)
 print("Ready to receive messages!")
 
 message_count = 0
 while True:
     try:
-        message = subscriber.recv_string()
+        message = subscriber.recv()
         message_count += 1
         if message_count % 10 == 0:  # Print every 10th message
             print(f"Received message {message_count}")
+            if message.startswith(LIDAR_FRAME_MAGIC):
+                header, points = parse_binary_frame(message)
+                print(f"Binary frame seq {header['sequence']}: {header['count']} points")
+                for i, point in enumerate(points[:5]):  # Show first 5 measurements
+                    print(f"Measurement {i}: {point[0] / 100.0},{point[1]}")
+                continue
+            message = message.decode()
             # Print first few measurements as sample
             parts = message.split(';')
             for i, part in enumerate(parts[:5]):  # Show first 5 measurements